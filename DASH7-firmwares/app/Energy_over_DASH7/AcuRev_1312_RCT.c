@@ -26,13 +26,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include "AcuRev_1312_RCT.h"
-#include "hwuart.h"
 #include "mmodbus.h"
-#include "math.h"
+#include "modbus_bus.h"
 #include "hwsystem.h"
 #include "timer.h"
+#include "modbus_planner.h"
 
 #define MODBUS_MAX_RETRIES 10
+#define MODBUS_RETRY_DELAY 3 // timer ticks between two attempts
+#define ACUREV_MAX_GAP 40 // unused registers that are cheaper to read through than to start another transaction
+#define ACUREV_DEFAULT_BAUDRATE 19200
+#define ACUREV_PROBE_TIMEOUT 100 // ms, a single register comes back well within this on every rate
+#define ACUREV_BAUDRATE_TEST_READS 8 // merged reads that have to come back CRC clean before a higher rate is kept
+#define ACUREV_ERROR_WINDOW 32 // attempts over which the garbled and lost answers get counted
+#define ACUREV_MAX_LINE_ERRORS 4 // more garbled or lost answers than this in a window mark the link as degraded
 
 
 #ifdef true
@@ -44,234 +51,468 @@
 #define DPRINT_DATA(...)
 #endif
 
-static uart_handle_t* uart;
-
 #define password 0
 
-#define device_address 1
 #define modbus_timeout 1000
 #define Total_Real_Energy_Imported_register 4211 // size 32 bit
 #define	Real_Energy_Sunpec_Scale_Factor_register 4219 // -3 - 0
 #define Total_Apparent_Energy_Imported_register 4228 // size 32 bit
 #define	Apparent_Energy_Sunspec_Scale_Factor_register 4236 // -3 - 0
 
-#define Total_Real_Energy_Phase_A_register 4213 // size 32 bit
-#define Total_Real_Energy_Phase_B_register 4215 // size 32 bit
-#define Total_Real_Energy_Phase_C_register 4217 // size 32 bit
-#define Real_Energy_Scale_Factor_register 4219 // -3 - 0
-
-#define Total_Apparent_Energy_Phase_A_register 4230 // size 32 bit
-#define Total_Apparent_Energy_Phase_B_register 4232 // size 32 bit
-#define Total_Apparent_Energy_Phase_C_register 4234 // size 32 bit
-#define Apparent_Energy_Scale_Factor_register 4236 // -3 - 0
-
-#define Voltage_Phase_A_register 4173 // size 16 bit
-#define Voltage_Phase_B_register 4174 // size 16 bit
-#define Voltage_Phase_C_register 4175 // size 16 bit
-#define Voltage_Scale_Factor_register 4180 // -2 - 2
-
-#define Current_Phase_A_register 4168 // size 16 bit
-#define Current_Phase_B_register 4169 // size 16 bit
-#define Current_Phase_C_register 4170 // size 16 bit
-#define Current_Scale_Factor_register 4171 // -3 - 5
+// the per phase registers of the measured quantities are listed in ACUREV_QUANTITIES
 
 #define Meter_Data_Reset_register 525  
 #define Communication_Revise_Operation_Authority_register 522 //0X02 : Meter Reset, Event Reset, Write Energy Data
 #define password_register 523 //default password 0
 #define new_password_register 524 //default password 0
+// system parameter 0x0201, holds the index of the rate in acurev_baudrates. The meter still answers the write on the
+// old rate and listens on the new one from then on
+#define Communication_Baud_Rate_register 513
+
+static const uint32_t acurev_baudrates[] = { 1200, 2400, 4800, 9600, 19200, 38400 };
+#define ACUREV_BAUDRATE_COUNT (sizeof(acurev_baudrates) / sizeof(acurev_baudrates[0]))
+
+typedef void (*acurev_decode_t)(MModBus_Transaction_t* transaction);
+typedef void (*acurev_quantity_decode_t)(const MModBus_Transaction_t* transaction, uint16_t first, acurev_values_t* values);
+
+#define ACUREV_QUANTITY_ENUM(name, first, width, raw_type, scale_register, exponent, type) ACUREV_QUANTITY_##name,
+typedef enum {
+    ACUREV_QUANTITIES(ACUREV_QUANTITY_ENUM)
+    ACUREV_QUANTITY_COUNT
+} acurev_quantity_t;
+
+// the values up to and including the scale factor get read in one go
+#define ACUREV_QUANTITY_RANGE(name, first, width, raw_type, scale_register, exponent, type) \
+    [ACUREV_QUANTITY_##name] = { first, (scale_register) - (first) + 1 },
+static const modbus_range_t acurev_ranges[ACUREV_QUANTITY_COUNT] = { ACUREV_QUANTITIES(ACUREV_QUANTITY_RANGE) };
+
+static MModBus_Transaction_t acurev_transaction;
+static acurev_decode_t acurev_decode;
+static acurev_callback_t acurev_callback;
+static uint8_t retry_counter = 0;
+static uint8_t acurev_max_retries;
+static modbus_bus_priority_t acurev_priority;
+static bool acurev_busy = false;
+
+static uint32_t acurev_baudrate = ACUREV_DEFAULT_BAUDRATE;
+static uint8_t acurev_attempts;
+static uint8_t acurev_line_errors;
+static bool acurev_degraded;
+static bool acurev_negotiating;
+static uint8_t negotiation_address;
+static uint32_t negotiation_ceiling;
+static uint32_t negotiation_order[ACUREV_BAUDRATE_COUNT];
+static uint8_t negotiation_candidate;
+static uint32_t negotiation_previous;
+static uint32_t negotiation_target;
+static uint8_t negotiation_tests;
+static acurev_baudrate_callback_t negotiation_callback;
+
+static modbus_plan_t acurev_plan;
+static uint8_t acurev_plan_read;
+static uint8_t acurev_slave_address;
+static acurev_values_t* acurev_values;
+static bool acurev_values_valid;
+static acurev_callback_t acurev_values_callback;
+
+static void acurev_submit_request();
+static void acurev_transaction_done(MModBus_Transaction_t* transaction);
 
 void acurev_1312_rct_init()
 {
-    uart = uart_init(0, 19200, 0);
-    uart_enable(uart);
-    uart_set_rx_interrupt_callback(uart, &modbus_callback_stack);
-    uart_rx_interrupt_enable(uart);
-    
-    mmodbus_init(modbus_timeout);
+    modbus_bus_init(acurev_baudrate, modbus_timeout);
     mmodbus_set32bitOrder(MModBus_32bitOrder_CDAB);
+    modbus_planner_plan(acurev_ranges, ACUREV_QUANTITY_COUNT, ACUREV_MAX_GAP, &acurev_plan);
     DPRINT("acurev inited");
-    sched_register_task(&acurev_gain_write_permission);
-    sched_register_task(&acurev_reset_meter_record);
+    sched_register_task(&acurev_submit_request);
 }
 
-bool acurev_get_real_energy(int64_t *real_energy_a, int64_t *real_energy_b, int64_t *real_energy_c)
+/**
+ * @brief Start the prepared acurev_transaction, the result gets decoded and reported in the background
+ * @param decode converts the response into the requested values, can be NULL
+ * @param callback called with the result once the request succeeded or all retries failed
+ * @param max_retries attempts after the first one before giving up
+ * @param priority of the request against the other drivers on the bus
+ * @return false if a previous request is still running
+ */
+static bool acurev_start_request(
+    acurev_decode_t decode, acurev_callback_t callback, uint8_t max_retries, modbus_bus_priority_t priority)
 {
-    uint32_t data[4];  // Array to store all 32-bit register values (3 energy registers + 1 scale factor register)
-    uint16_t raw_scale;
-    int16_t scale;
-    bool success = false;
-    uint8_t retry_counter = 0;
-    while (!success && retry_counter <= MODBUS_MAX_RETRIES)
-    {
-        // Read all registers in a single call
-        success = mmodbus_readHoldingRegisters32i(device_address, Total_Real_Energy_Phase_A_register, 4, data);
-        
-        if (success)
-        {
-            raw_scale = data[3] >> 16;
-            scale = (int16_t)raw_scale;
-
-            *real_energy_a = (int64_t)((int32_t)data[0] * pow(10, (int16_t)scale + 3));
-            *real_energy_b = (int64_t)((int32_t)data[1] * pow(10, (int16_t)scale + 3));
-            *real_energy_c = (int64_t)((int32_t)data[2] * pow(10, (int16_t)scale + 3));
-        }
-        else
-        {
-            hw_busy_wait(3000);
-        }
-
-        retry_counter++;
-        DPRINT("Attempt %d: Raw Data A: %d, Raw Data B: %d, Raw Data C: %d, Raw Scale: %d, Scale: %d, real_energy A: %d, real_energy B: %d, real_energy C: %d", 
-        retry_counter, data[0], data[1], data[2], data[3], scale, (int32_t)*real_energy_a, (int32_t)*real_energy_b, (int32_t)*real_energy_c); 
+    acurev_decode = decode;
+    acurev_callback = callback;
+    acurev_max_retries = max_retries;
+    acurev_priority = priority;
+    acurev_transaction.callback = &acurev_transaction_done;
+    retry_counter = 0;
+    acurev_busy = true;
+    sched_post_task(&acurev_submit_request);
+    return true;
+}
+
+static void acurev_submit_request()
+{
+    // the queue of the bus is full, try again a bit later
+    if (!modbus_bus_submit(&acurev_transaction, acurev_priority, MODBUS_BUS_NO_DEADLINE))
+        timer_post_task_delay(&acurev_submit_request, MODBUS_RETRY_DELAY);
+}
+
+// keeps track of the answers that got lost or garbled on the line, the rate falls back when there are too many
+static void acurev_count_line_errors(const MModBus_Transaction_t* transaction)
+{
+    // probes on a wrong rate are expected to fail
+    if (acurev_negotiating)
+        return;
+    if ((transaction->status != MModBus_Status_Ok) && (transaction->status != MModBus_Status_Exception))
+        acurev_line_errors++;
+    if (++acurev_attempts < ACUREV_ERROR_WINDOW)
+        return;
+    if (acurev_line_errors > ACUREV_MAX_LINE_ERRORS) {
+        log_print_error_string("acurev link degraded at %d baud, %d errors", acurev_baudrate, acurev_line_errors);
+        acurev_degraded = true;
     }
-    return success;
+    acurev_attempts = 0;
+    acurev_line_errors = 0;
 }
 
+static void acurev_transaction_done(MModBus_Transaction_t* transaction)
+{
+    retry_counter++;
+    acurev_count_line_errors(transaction);
+    if (transaction->success) {
+        if (acurev_decode)
+            acurev_decode(transaction);
+    } else if (mmodbus_isPermanentError(transaction)) {
+        // the meter rejected the request itself, asking again gives the same exception
+        log_print_error_string("acurev rejected register %d, exception %d", (transaction->txBuf[2] << 8) | transaction->txBuf[3], transaction->exception);
+    } else if (retry_counter <= acurev_max_retries) {
+        timer_post_task_delay(&acurev_submit_request, MODBUS_RETRY_DELAY);
+        return;
+    }
+
+    acurev_busy = false;
+    if (acurev_callback)
+        acurev_callback(transaction->success);
+}
+
+// a decoder per quantity, specialized on its register width and types
+#define ACUREV_QUANTITY_DECODER(name, first, width, raw_type, scale_register, exponent, type)                    \
+static void acurev_decode_##name(const MModBus_Transaction_t* transaction, uint16_t offset, acurev_values_t* values) \
+{                                                                                                             \
+    uint##width##_t data[3];                                                                                  \
+    uint16_t raw_scale;                                                                                       \
+    int16_t scale;                                                                                            \
+                                                                                                              \
+    mmodbus_getRegisterRange##width##i(transaction, offset, 3, data);                                         \
+    mmodbus_getRegisterRange16i(transaction, offset + (scale_register) - (first), 1, &raw_scale);             \
+    /* Transform raw scale to signed integer */                                                               \
+    scale = (int16_t)raw_scale;                                                                               \
+                                                                                                              \
+    for (uint8_t i = 0; i < 3; i++)                                                                           \
+        values->name[i] = (type)modbus_planner_scale((raw_type)data[i], scale + (exponent));                  \
+                                                                                                              \
+    DPRINT("Attempt %d: " #name " raw A: %d, B: %d, C: %d, scale: %d, converted A: %d, B: %d, C: %d",         \
+        retry_counter, data[0], data[1], data[2], scale,                                                      \
+        (int32_t)values->name[0], (int32_t)values->name[1], (int32_t)values->name[2]);                         \
+}
+ACUREV_QUANTITIES(ACUREV_QUANTITY_DECODER)
+
+#define ACUREV_QUANTITY_DECODER_ENTRY(name, first, width, raw_type, scale_register, exponent, type) \
+    [ACUREV_QUANTITY_##name] = &acurev_decode_##name,
+static const acurev_quantity_decode_t acurev_decoders[ACUREV_QUANTITY_COUNT] = { ACUREV_QUANTITIES(ACUREV_QUANTITY_DECODER_ENTRY) };
+
+static void acurev_decode_read(MModBus_Transaction_t* transaction)
+{
+    // hand every quantity that is part of this read its own registers
+    for (uint8_t i = 0; i < ACUREV_QUANTITY_COUNT; i++)
+        if (acurev_plan.range_read[i] == acurev_plan_read)
+            acurev_decoders[i](transaction, modbus_planner_range_offset(&acurev_plan, acurev_ranges, i), acurev_values);
+}
+
+static void acurev_read_done(bool success);
+
+static void acurev_read_next()
+{
+    const modbus_range_t* read = &acurev_plan.reads[acurev_plan_read];
+    mmodbus_prepareRead(&acurev_transaction, acurev_slave_address, MModbusCMD_ReadHoldingRegisters, read->start, read->length);
+    acurev_start_request(&acurev_decode_read, &acurev_read_done, MODBUS_MAX_RETRIES, MODBUS_BUS_PRIORITY_POLL);
+}
 
-bool acurev_get_apparent_energy(int64_t *apparent_energy_a, int64_t *apparent_energy_b, int64_t *apparent_energy_c)
+static void acurev_read_done(bool success)
 {
-    uint32_t data[4];  // Array to store all 32-bit register values (3 energy registers + 1 scale factor register)
-    int16_t scale;
-    uint16_t raw_scale;
-    bool success = false;
-    uint8_t retry_counter = 0;
-    while (!success && retry_counter <= MODBUS_MAX_RETRIES)
-    {
-        // Read all registers in a single call
-        success = mmodbus_readHoldingRegisters32i(device_address, Total_Apparent_Energy_Phase_A_register, 4, data);
-        
-        if (success)
-        {
-            // Transform raw scale to signed integer
-            raw_scale = data[3] >> 16;
-            scale = (int16_t)raw_scale;
-
-            *apparent_energy_a = (int64_t)((int32_t)data[0] * pow(10, (int16_t)scale + 3));
-            *apparent_energy_b = (int64_t)((int32_t)data[1] * pow(10, (int16_t)scale + 3));
-            *apparent_energy_c = (int64_t)((int32_t)data[2] * pow(10, (int16_t)scale + 3));
-        }
-        else
-        {
-            hw_busy_wait(3000);
-        }
-
-
-        retry_counter++;
-        DPRINT("Attempt %d: Raw Data A: %d, Raw Data B: %d, Raw Data C: %d, Raw Scale: %d, Scale: %d, apparent_energy A: %d, apparent_energy B: %d, apparent_energy C: %d", 
-        retry_counter, data[0], data[1], data[2], data[3], scale, (int32_t)*apparent_energy_a, (int32_t)*apparent_energy_b, (int32_t)*apparent_energy_c); 
+    if (!success && mmodbus_isPermanentError(&acurev_transaction) && (acurev_plan.read_count < ACUREV_QUANTITY_COUNT)) {
+        // the meter refuses to read through the registers in between, fall back to a read per quantity
+        log_print_error_string("acurev refused the merged read, reading every quantity separately");
+        modbus_planner_plan(acurev_ranges, ACUREV_QUANTITY_COUNT, 0, &acurev_plan);
+        acurev_plan_read = 0;
+        acurev_values_valid = true;
+        acurev_read_next();
+        return;
     }
-    return success;
+
+    acurev_values_valid &= success;
+    acurev_plan_read++;
+    if (acurev_plan_read < acurev_plan.read_count) {
+        acurev_read_next();
+        return;
+    }
+    if (acurev_values_callback)
+        acurev_values_callback(acurev_values_valid);
+}
+
+/**
+ * @brief Read out energy, voltage and current in the background
+ * The wanted registers are merged into as few reads as the planner allows
+ * @param slave_address the meter to read out, several meters can share the bus
+ * @param values receives the converted values
+ * @param callback called with the result once all reads are done, false if any of them failed
+ * @return false if a previous request is still running
+ */
+bool acurev_get_values(uint8_t slave_address, acurev_values_t* values, acurev_callback_t callback)
+{
+    if (acurev_busy)
+        return false;
+    acurev_slave_address = slave_address;
+    acurev_values = values;
+    acurev_values_callback = callback;
+    acurev_values_valid = true;
+    acurev_plan_read = 0;
+    acurev_read_next();
+    return true;
+}
+
+static void acurev_write_done(bool success)
+{
+    if (success)
+        log_print_string("Attempt %d: Written reset register %d", retry_counter, success);
+    else
+        log_print_string("Failed to write reset register after %d attempts", MODBUS_MAX_RETRIES);
+}
+
+static bool acurev_write(uint8_t slave_address, uint16_t start_register, uint16_t* data)
+{
+    if (acurev_busy)
+        return false;
+    if (!mmodbus_prepareWriteMultipleRegisters(&acurev_transaction, slave_address, start_register, 2, data))
+        return false;
+    return acurev_start_request(NULL, &acurev_write_done, MODBUS_MAX_RETRIES, MODBUS_BUS_PRIORITY_CONFIG);
+}
+
+/**
+ * @brief Allow the accumulated data of a meter to get reset, acurev_reset_meter_record has to follow
+ * @param slave_address the meter to reset
+ * @return false if a request is still running, try again later
+ */
+bool acurev_gain_write_permission(uint8_t slave_address)
+{
+    uint16_t data[] = {0x02, 0}; //gain permission for resetting data
+
+    return acurev_write(slave_address, Communication_Revise_Operation_Authority_register, data);
+}
+
+/**
+ * @brief Reset the accumulated data of a meter that got write permission before
+ * @param slave_address the meter to reset
+ * @return false if a request is still running, try again later
+ */
+bool acurev_reset_meter_record(uint8_t slave_address)
+{
+    uint16_t data2[] = {0, 0xFF}; // reset all data
+
+    return acurev_write(slave_address, new_password_register, data2);
 }
 
 
-bool acurev_get_voltage(int16_t *voltage_a, int16_t *voltage_b, int16_t *voltage_c)
+static void acurev_set_uart_baudrate(uint32_t baudrate)
+{
+    modbus_bus_set_baudrate(baudrate);
+    acurev_baudrate = baudrate;
+}
+
+static void acurev_negotiation_done(bool success)
+{
+    acurev_negotiating = false;
+    acurev_degraded = false;
+    acurev_attempts = 0;
+    acurev_line_errors = 0;
+    log_print_string("acurev %s at %d baud", success ? "talks" : "not found, staying", acurev_baudrate);
+    if (negotiation_callback)
+        negotiation_callback(success ? acurev_baudrate : 0);
+}
+
+static uint8_t acurev_baudrate_index(uint32_t baudrate)
 {
-    uint16_t data[8];  // Array to store all 16-bit register values (3 voltage registers + 4 unused registers + 1 scale register)
-    int16_t scale;
-    bool success = false;
-    uint8_t retry_counter = 0;
-
-    while (!success && retry_counter <= MODBUS_MAX_RETRIES)
-    {
-        // Read voltage registers and the scale register together
-        success = mmodbus_readHoldingRegisters16i(device_address, Voltage_Phase_A_register, 8, data);
-        
-        if (success)
-        {
-            // Transform raw scale to signed integer
-            scale = (int16_t)data[7];
-
-            *voltage_a = (int16_t)(data[0] * pow(10, scale));
-            *voltage_b = (int16_t)(data[1] * pow(10, scale));
-            *voltage_c = (int16_t)(data[2] * pow(10, scale));
-
-            DPRINT("Attempt %d: Raw Data A: %d, Raw Data B: %d, Raw Data C: %d, Raw Scale: %d, Scale: %d, Voltage A: %d, Voltage B: %d, Voltage C: %d", 
-                   retry_counter + 1, data[0], data[1], data[2], data[7], scale, *voltage_a, *voltage_b, *voltage_c);
-        }
-        else
-        {
-            hw_busy_wait(3000);
-        }
-
-
-        retry_counter++;
+    uint8_t index = 0;
+    while ((index + 1 < ACUREV_BAUDRATE_COUNT) && (acurev_baudrates[index + 1] <= baudrate))
+        index++;
+    return index;
+}
+
+static void acurev_rate_written(bool success);
+static void acurev_test_baudrate();
+
+static void acurev_write_baudrate(uint32_t baudrate, acurev_callback_t callback)
+{
+    mmodbus_prepareWriteSingle(&acurev_transaction, negotiation_address, MModbusCMD_WriteSingleRegister,
+        Communication_Baud_Rate_register, acurev_baudrate_index(baudrate));
+    acurev_start_request(NULL, callback, MODBUS_MAX_RETRIES, MODBUS_BUS_PRIORITY_CONFIG);
+}
+
+static void acurev_move_baudrate(uint32_t baudrate)
+{
+    negotiation_previous = acurev_baudrate;
+    negotiation_target = baudrate;
+    acurev_write_baudrate(baudrate, &acurev_rate_written);
+}
+
+static void acurev_rate_written(bool success)
+{
+    if (!success) {
+        acurev_negotiation_done(true);
+        return;
+    }
+    // the meter answered on the old rate and listens on the new one from now on
+    acurev_set_uart_baudrate(negotiation_target);
+    if (negotiation_target < negotiation_previous) {
+        acurev_negotiation_done(true);
+        return;
     }
+    negotiation_tests = 0;
+    acurev_test_baudrate();
+}
 
-    return success;
+static void acurev_restore_written(bool success)
+{
+    acurev_set_uart_baudrate(negotiation_previous);
+    if (success)
+        acurev_negotiation_done(true);
+    else
+        // the meter might still be on either rate, look for it again without raising
+        acurev_negotiate_baudrate(negotiation_address, negotiation_previous, negotiation_previous, negotiation_callback);
 }
 
+static void acurev_adjust_baudrate();
 
-bool acurev_get_current(int32_t *current_a, int32_t *current_b, int32_t *current_c)
+static void acurev_test_done(bool success)
 {
-    uint16_t data[4];  // Array to store all 16-bit register values (3 current registers + 1 scale register)
-    int16_t scale;
-    bool success = false;
-    uint8_t retry_counter = 0;
-
-    while (!success && retry_counter <= MODBUS_MAX_RETRIES)
-    {
-        // Read current registers and the scale register together
-        success = mmodbus_readHoldingRegisters16i(device_address, Current_Phase_A_register, 4, data);
-        
-        if (success)
-        {
-            // Transform raw scale to signed integer
-            scale = (int16_t)data[3];
-
-            *current_a = (int32_t)( (int16_t)data[0] * pow(10, scale + 3));
-            *current_b = (int32_t)( (int16_t)data[1] * pow(10, scale + 3));
-            *current_c = (int32_t)( (int16_t)data[2] * pow(10, scale + 3));
-
-            DPRINT("Attempt %d: Raw Data A: %d, Raw Data B: %d, Raw Data C: %d, raw Scale: %d, Scale: %d, Current A: %d, Current B: %d, Current C: %d", 
-                   retry_counter + 1, data[0], data[1], data[2], data[3], scale, *current_a, *current_b, *current_c);
-        }
-        else
-        {
-            hw_busy_wait(3000);
-        }
-        retry_counter++;
+    if (success && (++negotiation_tests < ACUREV_BAUDRATE_TEST_READS)) {
+        acurev_test_baudrate();
+        return;
+    }
+    if (success) {
+        acurev_adjust_baudrate();
+        return;
     }
+    // garbled on the new rate, move the meter back to the last rate that was clean
+    log_print_error_string("acurev not clean at %d baud", acurev_baudrate);
+    acurev_write_baudrate(negotiation_previous, &acurev_restore_written);
+}
 
-    return success;
+static void acurev_test_baudrate()
+{
+    // the longest read of a measurement, the most likely to get hit by a bit error
+    const modbus_range_t* read = &acurev_plan.reads[0];
+    mmodbus_prepareRead(&acurev_transaction, negotiation_address, MModbusCMD_ReadHoldingRegisters, read->start, read->length);
+    acurev_start_request(NULL, &acurev_test_done, 0, MODBUS_BUS_PRIORITY_CONFIG);
 }
 
-void acurev_gain_write_permission()
+// move the meter one rate closer to the ceiling, or finish when it is there
+static void acurev_adjust_baudrate()
 {
-    bool success = false;
-    uint16_t data[] = {0x02, 0}; //gain permission for resetting data
-    uint8_t retry_counter = 0;
-
-    while (!success && retry_counter <= MODBUS_MAX_RETRIES)
-    {
-        success = mmodbus_writeHoldingRegisters16i_length2(device_address, Communication_Revise_Operation_Authority_register, data);
-        if (success)
-            log_print_string("Attempt %d: Written reset register %d", retry_counter + 1, success);
-        else
-            hw_busy_wait(3000);
-        retry_counter++;
+    uint8_t index = acurev_baudrate_index(acurev_baudrate);
+    if (negotiation_ceiling == 0) {
+        acurev_negotiation_done(true);
+        return;
     }
-    if (!success)
-        log_print_string("Failed to write reset register after %d attempts", MODBUS_MAX_RETRIES);
+    if ((acurev_baudrate > negotiation_ceiling) && (index > 0)) {
+        acurev_move_baudrate(acurev_baudrates[index - 1]);
+        return;
+    }
+    if ((index + 1 < ACUREV_BAUDRATE_COUNT) && (acurev_baudrates[index + 1] <= negotiation_ceiling)) {
+        acurev_move_baudrate(acurev_baudrates[index + 1]);
+        return;
+    }
+    acurev_negotiation_done(true);
 }
 
-void acurev_reset_meter_record()
+static void acurev_probe_baudrate();
+
+static void acurev_probe_done(bool success)
 {
-    bool success = false; 
-    uint16_t data2[] = {0, 0xFF}; // reset all data
-    uint8_t retry_counter = 0;
-
-    while (!success && retry_counter <= MODBUS_MAX_RETRIES)
-    {
-        success = mmodbus_writeHoldingRegisters16i_length2(device_address, new_password_register, data2);
-        
-        if (success)
-            log_print_string("Attempt %d: Written reset register %d", retry_counter + 1, success);
-        else
-            hw_busy_wait(3000);
-        
-        retry_counter++;
+    // an exception also proves the meter understood the request
+    if (success || (acurev_transaction.status == MModBus_Status_Exception)) {
+        acurev_adjust_baudrate();
+        return;
+    }
+    negotiation_candidate++;
+    if (negotiation_candidate < ACUREV_BAUDRATE_COUNT) {
+        acurev_probe_baudrate();
+        return;
     }
+    acurev_set_uart_baudrate(negotiation_order[0]);
+    acurev_negotiation_done(false);
+}
 
-    if (!success)
-        log_print_string("Failed to write reset register after %d attempts", MODBUS_MAX_RETRIES);
-}
\ No newline at end of file
+static void acurev_probe_baudrate()
+{
+    acurev_set_uart_baudrate(negotiation_order[negotiation_candidate]);
+    mmodbus_prepareRead(&acurev_transaction, negotiation_address, MModbusCMD_ReadHoldingRegisters,
+        Real_Energy_Sunpec_Scale_Factor_register, 1);
+    acurev_transaction.timeout = ACUREV_PROBE_TIMEOUT;
+    acurev_start_request(NULL, &acurev_probe_done, 1, MODBUS_BUS_PRIORITY_CONFIG);
+}
+
+/**
+ * @brief Find the rate the meter talks at and move it as close to the ceiling as stays CRC clean
+ * The preferred rate gets probed first, then all others from fast to slow. A higher rate is only kept after
+ * ACUREV_BAUDRATE_TEST_READS clean reads, otherwise the meter goes back to the previous one.
+ * @param slave_address the meter to negotiate with, all meters on the bus have to share the rate
+ * @param preferred the rate the meter most likely talks at, the last negotiated one
+ * @param ceiling the highest rate to move the meter to, lower than the current rate to fall back,
+ * 0 to leave the meter on the rate it gets found at
+ * @param callback called with the rate once done, 0 if the meter did not answer on any rate
+ * @return false if a request is still running
+ */
+bool acurev_negotiate_baudrate(uint8_t slave_address, uint32_t preferred, uint32_t ceiling, acurev_baudrate_callback_t callback)
+{
+    uint8_t count = 0;
+
+    if (acurev_busy)
+        return false;
+    for (uint8_t i = 0; i < ACUREV_BAUDRATE_COUNT; i++)
+        if (acurev_baudrates[i] == preferred)
+            negotiation_order[count++] = preferred;
+    for (int8_t i = ACUREV_BAUDRATE_COUNT - 1; i >= 0; i--)
+        if (acurev_baudrates[i] != preferred)
+            negotiation_order[count++] = acurev_baudrates[i];
+    negotiation_address = slave_address;
+    negotiation_ceiling = ceiling;
+    negotiation_callback = callback;
+    negotiation_candidate = 0;
+    acurev_negotiating = true;
+    acurev_probe_baudrate();
+    return true;
+}
+
+/**
+ * @brief Get the next lower rate of the meter, to fall back to when the link degraded
+ */
+uint32_t acurev_get_lower_baudrate(uint32_t baudrate)
+{
+    for (int8_t i = ACUREV_BAUDRATE_COUNT - 1; i >= 0; i--)
+        if (acurev_baudrates[i] < baudrate)
+            return acurev_baudrates[i];
+    return acurev_baudrates[0];
+}
+
+uint32_t acurev_get_baudrate()
+{
+    return acurev_baudrate;
+}
+
+/**
+ * @brief Tell if too many answers got lost or garbled lately, cleared by the next negotiation
+ */
+bool acurev_link_degraded()
+{
+    return acurev_degraded;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <string.h>
+#include "discovery_file.h"
+#include "d7ap_fs.h"
+#include "errors.h"
+#include "little_queue.h"
+#include "log.h"
+#include "modbus_discovery.h"
+#include "stdint.h"
+#include "timer.h"
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+#define DISCOVERY_MAX_DEVICES 8
+
+#define DISCOVERY_FILE_ID 64
+#define DISCOVERY_FILE_SIZE sizeof(discovery_file_t)
+#define RAW_DISCOVERY_FILE_SIZE (3 + DISCOVERY_MAX_DEVICES * sizeof(modbus_discovery_device_t))
+
+typedef struct {
+    union {
+        uint8_t bytes[RAW_DISCOVERY_FILE_SIZE];
+        struct {
+            // written by the gateway to start a scan, cleared again once the result is in
+            uint8_t first_address;
+            uint8_t last_address;
+            uint8_t device_count;
+            modbus_discovery_device_t devices[DISCOVERY_MAX_DEVICES];
+        } __attribute__((__packed__));
+    };
+} discovery_file_t;
+
+static void file_modified_callback(uint8_t file_id);
+
+static discovery_file_t discovery_file_cached = (discovery_file_t) { .first_address = 0 };
+static modbus_discovery_device_t discovery_devices[DISCOVERY_MAX_DEVICES];
+
+/**
+ * @brief Initialize the discovery file
+ * Writing an address range in the discovery file scans the bus for slaves, the file then holds the slaves that
+ * answered so the result is still there after a reboot
+ * @return error_t
+ */
+error_t discovery_file_initialize()
+{
+    d7ap_fs_file_header_t permanent_file_header = { .file_permissions
+        = (file_permission_t) { .guest_read = true, .guest_write = true, .user_read = true, .user_write = true },
+        .file_properties.storage_class = FS_STORAGE_PERMANENT,
+        .length = DISCOVERY_FILE_SIZE,
+        .allocated_length = DISCOVERY_FILE_SIZE };
+
+    uint32_t length = DISCOVERY_FILE_SIZE;
+    error_t ret = d7ap_fs_read_file(DISCOVERY_FILE_ID, 0, discovery_file_cached.bytes, &length, ROOT_AUTH);
+    if (ret == -ENOENT) {
+        ret = d7ap_fs_init_file(DISCOVERY_FILE_ID, &permanent_file_header, discovery_file_cached.bytes);
+        if (ret != SUCCESS) {
+            log_print_error_string("Error initializing discovery file: %d", ret);
+            return ret;
+        }
+    } else if (ret != SUCCESS)
+        log_print_error_string("Error reading discovery file: %d", ret);
+
+    modbus_discovery_init();
+    d7ap_fs_register_file_modified_callback(DISCOVERY_FILE_ID, &file_modified_callback);
+    DPRINT("discovery file inited");
+    return ret;
+}
+
+static void discovery_scan_done(uint8_t device_count)
+{
+    discovery_file_cached.first_address = 0;
+    discovery_file_cached.last_address = 0;
+    discovery_file_cached.device_count = device_count;
+    memcpy(discovery_file_cached.devices, discovery_devices, sizeof(discovery_devices));
+    d7ap_fs_write_file(DISCOVERY_FILE_ID, 0, discovery_file_cached.bytes, DISCOVERY_FILE_SIZE, ROOT_AUTH);
+}
+
+static void file_modified_callback(uint8_t file_id)
+{
+    if (file_id != DISCOVERY_FILE_ID)
+        return;
+
+    uint32_t size = DISCOVERY_FILE_SIZE;
+    d7ap_fs_read_file(DISCOVERY_FILE_ID, 0, discovery_file_cached.bytes, &size, ROOT_AUTH);
+    // a range means the gateway asks for a scan, otherwise our own result got written
+    if (discovery_file_cached.first_address != 0)
+        discovery_file_start_scan(discovery_file_cached.first_address, discovery_file_cached.last_address);
+    else
+        queue_add_file(discovery_file_cached.bytes, DISCOVERY_FILE_SIZE, DISCOVERY_FILE_ID);
+}
+
+void discovery_file_start_scan(uint8_t first_address, uint8_t last_address)
+{
+    memset(discovery_devices, 0, sizeof(discovery_devices));
+    if (!modbus_discovery_scan(first_address, last_address, discovery_devices, DISCOVERY_MAX_DEVICES, &discovery_scan_done))
+        log_print_error_string("could not scan slaves %d to %d", first_address, last_address);
+}
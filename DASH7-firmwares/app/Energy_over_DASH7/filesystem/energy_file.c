@@ -31,6 +31,10 @@
 #include "stdint.h"
 #include "timer.h"
 #include "AcuRev_1312_RCT.h"
+#include "poll_list_file.h"
+#include "modbus_slave.h"
+#include "statistics_file.h"
+#include "modbus_bench.h"
 
 #ifdef true
 #define DPRINT(...) log_print_string(__VA_ARGS__)
@@ -42,9 +46,24 @@
 #define ENERGY_FILE_SIZE sizeof(energy_file_t)
 #define RAW_ENERGY_FILE_SIZE 67
 
+#define ENERGY_MAX_METERS 4
+// a sample only starts when the radio queue can take the records of all meters and this many more files
+#define ENERGY_QUEUE_RESERVE 1
+// timer ticks between the steps of a meter reset, also the wait when another request is still running
+#define ENERGY_RESET_STEP_DELAY (2 * TIMER_TICKS_PER_SEC)
+
+#define METER_ENERGY_FILE_ID 54
+#define METER_ENERGY_FILE_SIZE sizeof(meter_energy_file_t)
+#define RAW_METER_ENERGY_FILE_SIZE (1 + RAW_ENERGY_FILE_SIZE)
+
 #define ENERGY_CONFIG_FILE_ID 62
 #define ENERGY_CONFIG_FILE_SIZE sizeof(energy_config_file_t)
-#define RAW_ENERGY_CONFIG_FILE_SIZE 5
+#define RAW_ENERGY_CONFIG_FILE_SIZE (11 + ENERGY_MAX_METERS)
+
+// the register image a local master reads: the meters that measured fine, then a block per meter
+#define ENERGY_SLAVE_VALID_REGISTER 1
+#define ENERGY_SLAVE_FIRST_METER_REGISTER 2
+#define ENERGY_SLAVE_METER_REGISTERS 34 // slave address, energies, currents and voltages
 
 typedef struct {
     union {
@@ -67,12 +86,27 @@ typedef struct {
     };
 } energy_file_t;
 
+// the record of a single meter when several meters get measured
+typedef struct {
+    union {
+        uint8_t bytes[RAW_METER_ENERGY_FILE_SIZE];
+        struct {
+            uint8_t slave_address;
+            energy_file_t energy;
+        } __attribute__((__packed__));
+    };
+} meter_energy_file_t;
+
 typedef struct {
     union {
         uint8_t bytes[RAW_ENERGY_CONFIG_FILE_SIZE];
         struct {
             uint32_t interval;
             bool enabled;
+            uint8_t meter_count;
+            uint8_t meter_addresses[ENERGY_MAX_METERS]; // slave addresses of the meters that share the bus
+            uint32_t baudrate; // last negotiated rate of the meter link
+            uint8_t local_slave_address; // address to answer a local master on, 0 for none
         } __attribute__((__packed__));
     };
 } energy_config_file_t;
@@ -82,23 +116,25 @@ static energy_file_t energy_file;
 static void file_modified_callback(uint8_t file_id);
 void energy_file_execute_measurement();
 void measure_acurev_data();
+static void energy_file_reset_next_meter();
 
 static energy_config_file_t energy_config_file_cached
-    = (energy_config_file_t) { .interval = 10 * 60, .enabled = true };
+    = (energy_config_file_t) { .interval = 10 * 60, .enabled = true, .meter_count = 1, .meter_addresses = { 1 },
+          .baudrate = 19200 };
+
+static void energy_file_negotiate_baudrate(uint32_t ceiling);
+static void energy_file_schedule_measurement();
+static void energy_file_set_slave_address();
 
 static bool energy_file_transmit_state = false;
 static bool energy_config_file_transmit_state = false;
 
-typedef enum {
-    MEASURING_REAL_ENERGY = 0,
-    MEASURING_APPARENT_ENERGY = 1,
-    MEASURING_VOLTAGE = 2,
-    MEASURING_CURRENT = 3,
-    MEASURING_DONE = 4,
-} measurement_state_t;
-
-static measurement_state_t measurement_state = MEASURING_DONE;
-bool current_measurement_valid = true;
+static acurev_values_t acurev_values;
+static meter_energy_file_t meter_energy_file;
+static uint8_t meter_index;
+static bool energy_measuring; // a sample is being read out, the bus stage holds a single one
+static uint8_t reset_meter_index;
+static bool reset_permission_granted; // the meter at reset_meter_index may get its data reset
 
 
 
@@ -140,13 +176,28 @@ error_t energy_files_initialize()
         log_print_error_string("Error initializing energy file: %d", ret);
     }
 
+    volatile_file_header.length = METER_ENERGY_FILE_SIZE;
+    volatile_file_header.allocated_length = METER_ENERGY_FILE_SIZE;
+    ret = d7ap_fs_init_file(METER_ENERGY_FILE_ID, &volatile_file_header, meter_energy_file.bytes);
+    if (ret != SUCCESS) {
+        log_print_error_string("Error initializing meter energy file: %d", ret);
+    }
+
     acurev_1312_rct_init(); //init the energy measurement device
+    energy_file_negotiate_baudrate(UINT32_MAX);
+    modbus_slave_init();
+#ifdef MODBUS_BENCH
+    modbus_bench_init();
+#endif
+    energy_file_set_slave_address();
 
     // set the configurations of the configuration file and register a callback on all changes on those files
     d7ap_fs_register_file_modified_callback(ENERGY_CONFIG_FILE_ID, &file_modified_callback);
     d7ap_fs_register_file_modified_callback(ENERGY_FILE_ID, &file_modified_callback);
+    d7ap_fs_register_file_modified_callback(METER_ENERGY_FILE_ID, &file_modified_callback);
     sched_register_task(&energy_file_execute_measurement);
     sched_register_task(&measure_acurev_data);
+    sched_register_task(&energy_file_reset_next_meter);
     DPRINT("energy file inited");
     return ret;
 }
@@ -157,12 +208,10 @@ static void file_modified_callback(uint8_t file_id)
         // energy config file got modified
         uint32_t size = ENERGY_CONFIG_FILE_SIZE;
         d7ap_fs_read_file(ENERGY_CONFIG_FILE_ID, 0, energy_config_file_cached.bytes, &size, ROOT_AUTH);
+        energy_file_set_slave_address();
         // set a timer to read the energy periodically
-        if (energy_config_file_cached.enabled && energy_file_transmit_state)
-            timer_post_task_delay(
-                &energy_file_execute_measurement, energy_config_file_cached.interval * TIMER_TICKS_PER_SEC);
-        else
-            timer_cancel_task(&energy_file_execute_measurement);
+        timer_cancel_task(&energy_file_execute_measurement);
+        energy_file_schedule_measurement();
 
         if (energy_config_file_transmit_state)
             queue_add_file(
@@ -172,9 +221,19 @@ static void file_modified_callback(uint8_t file_id)
         uint32_t size = ENERGY_FILE_SIZE;
         d7ap_fs_read_file(ENERGY_FILE_ID, 0, energy_file.bytes, &size, ROOT_AUTH);
         queue_add_file(energy_file.bytes, ENERGY_FILE_SIZE, ENERGY_FILE_ID);
+    } else if (file_id == METER_ENERGY_FILE_ID) {
+        // the record of one of the meters got written
+        uint32_t size = METER_ENERGY_FILE_SIZE;
+        d7ap_fs_read_file(METER_ENERGY_FILE_ID, 0, meter_energy_file.bytes, &size, ROOT_AUTH);
+        queue_add_file(meter_energy_file.bytes, METER_ENERGY_FILE_SIZE, METER_ENERGY_FILE_ID);
+    }
+}
+
+static void energy_file_schedule_measurement()
+{
+    if (energy_config_file_cached.enabled && energy_file_transmit_state)
         timer_post_task_delay(
             &energy_file_execute_measurement, energy_config_file_cached.interval * TIMER_TICKS_PER_SEC);
-    }
 }
 
 void energy_file_transmit_config_file()
@@ -184,42 +243,178 @@ void energy_file_transmit_config_file()
     queue_add_file(energy_config_file_cached.bytes, ENERGY_CONFIG_FILE_SIZE, ENERGY_CONFIG_FILE_ID);
 }
 
-void energy_file_execute_measurement()
+static void poll_list_measurement_done(bool success)
 {
-    measurement_state = MEASURING_REAL_ENERGY;
-    current_measurement_valid = true;
-    measure_acurev_data();
+    // the poll values file takes the place of the energy file and got queued already
+    energy_measuring = false;
 }
 
-void measure_acurev_data()
+// a configuration without valid meters falls back to the single meter on address 1
+static bool energy_file_meters_configured()
 {
-    DPRINT("executing energy measurement");
-    
-    if(measurement_state == MEASURING_REAL_ENERGY)
-    {
-        current_measurement_valid &= acurev_get_real_energy(&energy_file.real_energy_a, &energy_file.real_energy_b, &energy_file.real_energy_c);
-        measurement_state = MEASURING_APPARENT_ENERGY;
-        timer_post_task_delay(&measure_acurev_data, 50);
+    return (energy_config_file_cached.meter_count > 0) && (energy_config_file_cached.meter_count <= ENERGY_MAX_METERS);
+}
+
+static uint8_t energy_file_meter_count()
+{
+    return energy_file_meters_configured() ? energy_config_file_cached.meter_count : 1;
+}
+
+static uint8_t energy_file_meter_address(uint8_t index)
+{
+    return energy_file_meters_configured() ? energy_config_file_cached.meter_addresses[index] : 1;
+}
+
+// the node answers a local master on its own address, a meter on the same address would answer along
+static void energy_file_set_slave_address()
+{
+    uint8_t address = energy_config_file_cached.local_slave_address;
+
+    for (uint8_t i = 0; (address != 0) && (i < energy_file_meter_count()); i++) {
+        if (energy_file_meter_address(i) == address) {
+            log_print_error_string("local slave address %d taken by a meter", address);
+            address = 0;
+        }
     }
-    else if(measurement_state == MEASURING_APPARENT_ENERGY)
-    {
-        current_measurement_valid &= acurev_get_apparent_energy(&energy_file.apparent_energy_a, &energy_file.apparent_energy_b, &energy_file.apparent_energy_c);
-        measurement_state = MEASURING_VOLTAGE;
-        timer_post_task_delay(&measure_acurev_data, 50);
+    modbus_slave_set_address(address);
+}
+
+static void baudrate_negotiated(uint32_t baudrate)
+{
+#ifdef MODBUS_BENCH
+    // the meter is found, measure the link to it now that nothing else uses the bus.
+    // Only a meter that may be moved gets swept through the lower rates, like the negotiation itself
+    if (baudrate != 0)
+        modbus_bench_start_suite(energy_file_meter_address(0),
+            (energy_file_meter_count() == 1) && (energy_config_file_cached.local_slave_address == 0));
+#endif
+    // remember the rate so the next boot finds the meter with its first probe
+    if ((baudrate == 0) || (baudrate == energy_config_file_cached.baudrate))
+        return;
+    energy_config_file_cached.baudrate = baudrate;
+    d7ap_fs_write_file(ENERGY_CONFIG_FILE_ID, 0, energy_config_file_cached.bytes, ENERGY_CONFIG_FILE_SIZE, ROOT_AUTH);
+}
+
+static void energy_file_negotiate_baudrate(uint32_t ceiling)
+{
+    // meters sharing the bus have to keep the same rate, only a single meter gets moved to another one.
+    // A local master stays on the rate it got configured for, the node has to keep answering it there
+    if ((energy_file_meter_count() > 1) || (energy_config_file_cached.local_slave_address != 0))
+        ceiling = 0;
+    acurev_negotiate_baudrate(
+        energy_file_meter_address(0), energy_config_file_cached.baudrate, ceiling, &baudrate_negotiated);
+}
+
+void energy_file_execute_measurement()
+{
+    // the interval runs from the start of a sample, the next one gets read while this one waits for the radio
+    energy_file_schedule_measurement();
+    if (energy_measuring) {
+        log_print_error_string("previous measurement still running, sample skipped");
+        return;
     }
-    else if(measurement_state == MEASURING_VOLTAGE)
-    {
-        current_measurement_valid &= acurev_get_voltage(&energy_file.voltage_a, &energy_file.voltage_b, &energy_file.voltage_c);
-        measurement_state = MEASURING_CURRENT;
-        timer_post_task_delay(&measure_acurev_data, 50);
+    // the queue is the buffer towards the radio, when it falls behind the samples get dropped here instead of there
+    if (!queue_has_room(energy_file_meter_count() + ENERGY_QUEUE_RESERVE, METER_ENERGY_FILE_SIZE)) {
+        log_print_error_string("uplink behind, sample skipped");
+        return;
+    }
+
+    // publish how the link behaved up to this cycle
+    statistics_file_update();
+    // too many garbled answers lately, fall back to a slower rate before measuring
+    if (acurev_link_degraded())
+        energy_file_negotiate_baudrate(acurev_get_lower_baudrate(acurev_get_baudrate()));
+    energy_measuring = true;
+    // a downloaded poll list replaces the fixed set of AcuRev quantities
+    if (poll_list_file_execute_measurement(&poll_list_measurement_done))
+        return;
+    meter_index = 0;
+    measure_acurev_data();
+}
+
+// 64 and 32 bit values go high word first
+static uint8_t energy_file_put_registers(uint16_t* registers, int64_t value, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+        registers[i] = (uint16_t)(value >> (16 * (count - 1 - i)));
+    return count;
+}
+
+static void energy_file_update_slave_image(bool success)
+{
+    static uint16_t valid_meters;
+    uint16_t registers[ENERGY_SLAVE_METER_REGISTERS];
+    uint8_t r = 0;
+
+    if (!success) {
+        // keep the last values, the age register tells how old they are
+        valid_meters &= ~(1 << meter_index);
+        modbus_slave_write_registers(ENERGY_SLAVE_VALID_REGISTER, &valid_meters, 1);
+        return;
     }
-    else if(measurement_state == MEASURING_CURRENT)
-    {
-        current_measurement_valid &= acurev_get_current(&energy_file.current_a, &energy_file.current_b, &energy_file.current_c);
-        energy_file.measurement_valid = current_measurement_valid;
+    registers[r++] = energy_file_meter_address(meter_index);
+    r += energy_file_put_registers(&registers[r], energy_file.apparent_energy_a, 4);
+    r += energy_file_put_registers(&registers[r], energy_file.apparent_energy_b, 4);
+    r += energy_file_put_registers(&registers[r], energy_file.apparent_energy_c, 4);
+    r += energy_file_put_registers(&registers[r], energy_file.real_energy_a, 4);
+    r += energy_file_put_registers(&registers[r], energy_file.real_energy_b, 4);
+    r += energy_file_put_registers(&registers[r], energy_file.real_energy_c, 4);
+    r += energy_file_put_registers(&registers[r], energy_file.current_a, 2);
+    r += energy_file_put_registers(&registers[r], energy_file.current_b, 2);
+    r += energy_file_put_registers(&registers[r], energy_file.current_c, 2);
+    r += energy_file_put_registers(&registers[r], energy_file.voltage_a, 1);
+    r += energy_file_put_registers(&registers[r], energy_file.voltage_b, 1);
+    r += energy_file_put_registers(&registers[r], energy_file.voltage_c, 1);
+    modbus_slave_write_registers(
+        ENERGY_SLAVE_FIRST_METER_REGISTER + meter_index * ENERGY_SLAVE_METER_REGISTERS, registers, r);
+    valid_meters |= 1 << meter_index;
+    modbus_slave_write_registers(ENERGY_SLAVE_VALID_REGISTER, &valid_meters, 1);
+    modbus_slave_refreshed();
+}
+
+static void acurev_measurement_done(bool success)
+{
+    // all quantities got read out in the background
+    energy_file.real_energy_a = acurev_values.real_energy[0];
+    energy_file.real_energy_b = acurev_values.real_energy[1];
+    energy_file.real_energy_c = acurev_values.real_energy[2];
+    energy_file.apparent_energy_a = acurev_values.apparent_energy[0];
+    energy_file.apparent_energy_b = acurev_values.apparent_energy[1];
+    energy_file.apparent_energy_c = acurev_values.apparent_energy[2];
+    energy_file.voltage_a = acurev_values.voltage[0];
+    energy_file.voltage_b = acurev_values.voltage[1];
+    energy_file.voltage_c = acurev_values.voltage[2];
+    energy_file.current_a = acurev_values.current[0];
+    energy_file.current_b = acurev_values.current[1];
+    energy_file.current_c = acurev_values.current[2];
+    energy_file.measurement_valid = success;
+    energy_file_update_slave_image(success);
+
+    // a single meter keeps the energy file without slave address
+    if (energy_file_meter_count() == 1) {
         d7ap_fs_write_file(ENERGY_FILE_ID, 0, energy_file.bytes, sizeof(energy_file), ROOT_AUTH);
-        measurement_state = MEASURING_DONE;
+        energy_measuring = false;
+        return;
     }
+
+    // every meter gets its own record, they all get queued in the same wake-up
+    meter_energy_file.slave_address = energy_file_meter_address(meter_index);
+    meter_energy_file.energy = energy_file;
+    d7ap_fs_write_file(METER_ENERGY_FILE_ID, 0, meter_energy_file.bytes, METER_ENERGY_FILE_SIZE, ROOT_AUTH);
+    meter_index++;
+    if (meter_index < energy_file_meter_count())
+        measure_acurev_data();
+    else
+        energy_measuring = false;
+}
+
+void measure_acurev_data()
+{
+    DPRINT("executing energy measurement");
+
+    // the meter is still busy with another request, try again later
+    if (!acurev_get_values(energy_file_meter_address(meter_index), &acurev_values, &acurev_measurement_done))
+        timer_post_task_delay(&measure_acurev_data, 50);
 }
 
 
@@ -229,9 +424,7 @@ void energy_file_set_measure_state(bool enable)
     timer_cancel_task(&energy_file_execute_measurement);
     energy_file_transmit_state = enable;
     energy_config_file_transmit_state = enable;
-    if (energy_config_file_cached.enabled && energy_file_transmit_state)
-        timer_post_task_delay(
-            &energy_file_execute_measurement, energy_config_file_cached.interval * TIMER_TICKS_PER_SEC);
+    energy_file_schedule_measurement();
 }
 
 
@@ -255,8 +448,31 @@ void energy_file_set_interval(uint32_t interval)
     }
 }
 
+// every meter first gets write permission and then its reset, one step at a time
+static void energy_file_reset_next_meter()
+{
+    uint8_t address = energy_file_meter_address(reset_meter_index);
+    bool started;
+
+    if (reset_permission_granted)
+        started = acurev_reset_meter_record(address);
+    else
+        started = acurev_gain_write_permission(address);
+    if (!started) {
+        timer_post_task_delay(&energy_file_reset_next_meter, ENERGY_RESET_STEP_DELAY);
+        return;
+    }
+    reset_permission_granted = !reset_permission_granted;
+    if (!reset_permission_granted)
+        reset_meter_index++;
+    if (reset_meter_index < energy_file_meter_count())
+        timer_post_task_delay(&energy_file_reset_next_meter, ENERGY_RESET_STEP_DELAY);
+}
+
 void energy_file_reset_accumulated_energy_data()
 {
-    timer_post_task_delay(&acurev_gain_write_permission, 5 * TIMER_TICKS_PER_SEC);
-    timer_post_task_delay(&acurev_reset_meter_record, 7 * TIMER_TICKS_PER_SEC);
+    // a reset that is still running starts over with the first meter
+    reset_meter_index = 0;
+    reset_permission_granted = false;
+    timer_post_task_delay(&energy_file_reset_next_meter, 5 * TIMER_TICKS_PER_SEC);
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <string.h>
+#include "forward_file.h"
+#include "d7ap_fs.h"
+#include "errors.h"
+#include "little_queue.h"
+#include "log.h"
+#include "mmodbus.h"
+#include "modbus_bus.h"
+#include "scheduler.h"
+#include "stdint.h"
+#include "timer.h"
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+#define FORWARD_MAX_PDUS 8
+#define FORWARD_MAX_DATA 60 // response bytes that fit in a single uplink next to the header
+#define FORWARD_MAX_RETRIES 2 // only for lost or garbled answers, exceptions get forwarded as they are
+#define FORWARD_BUSY_DELAY 3 // timer ticks between two attempts
+#define FORWARD_DEADLINE 2000 // ms a request may wait for the bus, it fails with a timeout after that
+#define FORWARD_STATUS_REFUSED 0xFF // the node did not send the request, it can not be forwarded
+
+#define FORWARD_REQUEST_FILE_ID 55
+#define FORWARD_REQUEST_FILE_SIZE sizeof(forward_request_file_t)
+#define RAW_FORWARD_REQUEST_FILE_SIZE (1 + FORWARD_MAX_PDUS * sizeof(forward_pdu_t))
+
+#define FORWARD_RESPONSE_FILE_ID 56
+#define FORWARD_RESPONSE_FILE_SIZE sizeof(forward_response_file_t)
+#define RAW_FORWARD_RESPONSE_FILE_SIZE (5 + FORWARD_MAX_DATA)
+
+// a read or single write as it goes on the wire, without the CRC
+typedef struct {
+    uint8_t slave;
+    uint8_t function;
+    uint8_t address[2]; // big endian, like on the wire
+    uint8_t value[2]; // register count of a read, value of a write
+} __attribute__((__packed__)) forward_pdu_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[RAW_FORWARD_REQUEST_FILE_SIZE];
+        struct {
+            // written by the gateway to forward the requests, cleared again once all answers got sent
+            uint8_t pdu_count;
+            forward_pdu_t pdus[FORWARD_MAX_PDUS];
+        } __attribute__((__packed__));
+    };
+} forward_request_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[RAW_FORWARD_RESPONSE_FILE_SIZE];
+        struct {
+            uint8_t index; // of the request in the request file
+            uint8_t slave;
+            uint8_t function; // with bit 7 set when the slave answered with an exception
+            uint8_t status; // MModBus_Status_t, FORWARD_STATUS_REFUSED if it did not get sent
+            uint8_t length;
+            uint8_t data[FORWARD_MAX_DATA]; // the response after the function code, without the CRC
+        } __attribute__((__packed__));
+    };
+} forward_response_file_t;
+
+static void file_modified_callback(uint8_t file_id);
+static void forward_submit_request();
+static void forward_transaction_done(MModBus_Transaction_t* transaction);
+static void forward_load();
+
+static forward_request_file_t forward_request_file;
+static forward_response_file_t forward_response_file;
+static MModBus_Transaction_t forward_transaction;
+static uint8_t forward_index;
+static uint8_t retry_counter;
+static bool forward_busy;
+static bool forward_reload; // the gateway wrote new requests while the previous ones were still running
+
+/**
+ * @brief Initialize the forward request and response files
+ * Every read or single write in the request file gets executed on the bus, the answer of each of them gets sent
+ * back in the response file
+ * @return error_t
+ */
+error_t forward_files_initialize()
+{
+    d7ap_fs_file_header_t volatile_file_header = { .file_permissions
+        = (file_permission_t) { .guest_read = true, .guest_write = true, .user_read = true, .user_write = true },
+        .file_properties.storage_class = FS_STORAGE_VOLATILE,
+        .length = FORWARD_REQUEST_FILE_SIZE,
+        .allocated_length = FORWARD_REQUEST_FILE_SIZE };
+
+    error_t ret = d7ap_fs_init_file(FORWARD_REQUEST_FILE_ID, &volatile_file_header, forward_request_file.bytes);
+    if (ret != SUCCESS) {
+        log_print_error_string("Error initializing forward request file: %d", ret);
+        return ret;
+    }
+
+    volatile_file_header.file_permissions = (file_permission_t) { .guest_read = true, .user_read = true };
+    volatile_file_header.length = FORWARD_RESPONSE_FILE_SIZE;
+    volatile_file_header.allocated_length = FORWARD_RESPONSE_FILE_SIZE;
+    ret = d7ap_fs_init_file(FORWARD_RESPONSE_FILE_ID, &volatile_file_header, forward_response_file.bytes);
+    if (ret != SUCCESS) {
+        log_print_error_string("Error initializing forward response file: %d", ret);
+        return ret;
+    }
+
+    d7ap_fs_register_file_modified_callback(FORWARD_REQUEST_FILE_ID, &file_modified_callback);
+    d7ap_fs_register_file_modified_callback(FORWARD_RESPONSE_FILE_ID, &file_modified_callback);
+    sched_register_task(&forward_submit_request);
+    DPRINT("forward files inited");
+    return ret;
+}
+
+static void forward_respond(uint8_t status, const uint8_t* data, uint8_t length)
+{
+    const forward_pdu_t* pdu = &forward_request_file.pdus[forward_index];
+
+    forward_response_file.index = forward_index;
+    forward_response_file.slave = pdu->slave;
+    forward_response_file.function = pdu->function;
+    forward_response_file.status = status;
+    if (status == MModBus_Status_Exception)
+        forward_response_file.function |= 0x80;
+    forward_response_file.length = (length < FORWARD_MAX_DATA) ? length : FORWARD_MAX_DATA;
+    if (length > 0)
+        memcpy(forward_response_file.data, data, forward_response_file.length);
+    d7ap_fs_write_file(
+        FORWARD_RESPONSE_FILE_ID, 0, forward_response_file.bytes, FORWARD_RESPONSE_FILE_SIZE, ROOT_AUTH);
+}
+
+static bool forward_prepare(const forward_pdu_t* pdu)
+{
+    uint16_t address = (pdu->address[0] << 8) | pdu->address[1];
+    uint16_t value = (pdu->value[0] << 8) | pdu->value[1];
+
+    switch (pdu->function) {
+    case MModbusCMD_ReadCoilStatus:
+    case MModbusCMD_ReadDiscreteInputs:
+        return ((value + 7) / 8 <= FORWARD_MAX_DATA - 1)
+            && mmodbus_prepareRead(&forward_transaction, pdu->slave, pdu->function, address, value);
+    case MModbusCMD_ReadHoldingRegisters:
+    case MModbusCMD_ReadInputRegisters:
+        // the answer has to fit in a single uplink, longer reads have to be split by the gateway
+        return (value * 2 <= FORWARD_MAX_DATA - 1)
+            && mmodbus_prepareRead(&forward_transaction, pdu->slave, pdu->function, address, value);
+    case MModbusCMD_WriteSingleCoil:
+    case MModbusCMD_WriteSingleRegister:
+        return mmodbus_prepareWriteSingle(&forward_transaction, pdu->slave, pdu->function, address, value);
+    default:
+        return false;
+    }
+}
+
+// runs the requests one after the other, every answer gets its own uplink
+static void forward_next()
+{
+    while (forward_index < forward_request_file.pdu_count) {
+        if (forward_prepare(&forward_request_file.pdus[forward_index])) {
+            forward_transaction.callback = &forward_transaction_done;
+            retry_counter = 0;
+            sched_post_task(&forward_submit_request);
+            return;
+        }
+        log_print_error_string("can not forward function %d", forward_request_file.pdus[forward_index].function);
+        forward_respond(FORWARD_STATUS_REFUSED, NULL, 0);
+        forward_index++;
+    }
+
+    forward_busy = false;
+    // newer requests of the gateway are in the file already, clearing it would lose them
+    if (forward_reload) {
+        forward_reload = false;
+        forward_load();
+        return;
+    }
+    forward_request_file.pdu_count = 0;
+    d7ap_fs_write_file(FORWARD_REQUEST_FILE_ID, 0, forward_request_file.bytes, FORWARD_REQUEST_FILE_SIZE, ROOT_AUTH);
+}
+
+static void forward_transaction_done(MModBus_Transaction_t* transaction)
+{
+    retry_counter++;
+    if ((transaction->status != MModBus_Status_Ok) && (transaction->status != MModBus_Status_Exception)
+        && (retry_counter <= FORWARD_MAX_RETRIES)) {
+        timer_post_task_delay(&forward_submit_request, FORWARD_BUSY_DELAY);
+        return;
+    }
+
+    if (transaction->status == MModBus_Status_Exception)
+        forward_respond(transaction->status, &transaction->exception, 1);
+    else if (transaction->txBuf[1] <= MModbusCMD_ReadInputRegisters)
+        // reads get forwarded with their byte count, like on the wire
+        forward_respond(transaction->status, transaction->data ? transaction->data - 1 : NULL,
+            transaction->data ? transaction->dataLength + 1 : 0);
+    else
+        forward_respond(transaction->status, transaction->data, transaction->dataLength);
+    forward_index++;
+    forward_next();
+}
+
+static void forward_submit_request()
+{
+    // the gateway waits for the answer, it overtakes the periodic measurements at the next frame boundary
+    if (!modbus_bus_submit(&forward_transaction, MODBUS_BUS_PRIORITY_URGENT, FORWARD_DEADLINE))
+        timer_post_task_delay(&forward_submit_request, FORWARD_BUSY_DELAY);
+}
+
+static void file_modified_callback(uint8_t file_id)
+{
+    if (file_id == FORWARD_RESPONSE_FILE_ID) {
+        queue_add_file(forward_response_file.bytes, FORWARD_RESPONSE_FILE_SIZE, FORWARD_RESPONSE_FILE_ID);
+        return;
+    }
+
+    // the cached requests are still being executed, they only get replaced once all of them are answered
+    if (forward_busy) {
+        DPRINT("forward requests wait for the previous ones");
+        forward_reload = true;
+        return;
+    }
+    forward_load();
+}
+
+static void forward_load()
+{
+    uint32_t size = FORWARD_REQUEST_FILE_SIZE;
+    d7ap_fs_read_file(FORWARD_REQUEST_FILE_ID, 0, forward_request_file.bytes, &size, ROOT_AUTH);
+    if (forward_request_file.pdu_count == 0)
+        return;
+    if (forward_request_file.pdu_count > FORWARD_MAX_PDUS)
+        forward_request_file.pdu_count = FORWARD_MAX_PDUS;
+    DPRINT("forwarding %d requests", forward_request_file.pdu_count);
+    forward_busy = true;
+    forward_index = 0;
+    forward_next();
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef DISCOVERY_FILE_H
+#define DISCOVERY_FILE_H
+
+#include "errors.h"
+#include "stdint.h"
+
+error_t discovery_file_initialize();
+void discovery_file_start_scan(uint8_t first_address, uint8_t last_address);
+
+#endif
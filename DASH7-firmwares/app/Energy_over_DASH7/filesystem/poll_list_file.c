@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <string.h>
+#include "poll_list_file.h"
+#include "d7ap_fs.h"
+#include "errors.h"
+#include "little_queue.h"
+#include "log.h"
+#include "stdint.h"
+#include "timer.h"
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+#define POLL_VALUES_FILE_ID 53
+#define POLL_VALUES_FILE_SIZE sizeof(poll_values_file_t)
+#define RAW_POLL_VALUES_FILE_SIZE 64
+
+#define POLL_LIST_FILE_ID 63
+#define POLL_LIST_FILE_SIZE sizeof(poll_list_file_t)
+#define RAW_POLL_LIST_FILE_SIZE (1 + MODBUS_POLLER_MAX_ENTRIES * sizeof(modbus_poll_entry_t))
+
+#define POLL_VALUES_WIDE 0x80 // set in the header of a block when its values are 64 bit instead of 32 bit
+
+typedef struct {
+    union {
+        uint8_t bytes[RAW_POLL_VALUES_FILE_SIZE];
+        struct {
+            uint8_t valid_entries;
+            uint8_t entry_count;
+            // per entry a header with the value count and POLL_VALUES_WIDE, followed by its little endian values
+            uint8_t blocks[RAW_POLL_VALUES_FILE_SIZE - 2];
+        } __attribute__((__packed__));
+    };
+} poll_values_file_t;
+
+typedef struct {
+    union {
+        uint8_t bytes[RAW_POLL_LIST_FILE_SIZE];
+        struct {
+            uint8_t entry_count;
+            modbus_poll_entry_t entries[MODBUS_POLLER_MAX_ENTRIES];
+        } __attribute__((__packed__));
+    };
+} poll_list_file_t;
+
+static void file_modified_callback(uint8_t file_id);
+static void poll_list_measure();
+
+// an empty poll list keeps the fixed energy file of the AcuRev
+static poll_list_file_t poll_list_file_cached = (poll_list_file_t) { .entry_count = 0 };
+static bool poll_list_planned = false;
+static bool poll_list_reload = false;
+
+static poll_values_file_t poll_values_file;
+static int64_t poll_values[MODBUS_POLLER_MAX_VALUES];
+static uint8_t poll_valid_entries;
+static modbus_poller_callback_t poll_list_callback;
+
+// 16 bit registers get converted to 32 bit values and 32 bit registers to 64 bit values to make room for the scale
+static uint8_t poll_list_value_size(const modbus_poll_entry_t* entry)
+{
+    return 4 * modbus_poller_type_width(entry->type);
+}
+
+static void poll_list_load()
+{
+    uint32_t size = POLL_LIST_FILE_SIZE;
+    uint16_t values_size = 2;
+
+    poll_list_reload = false;
+    poll_list_planned = false;
+    d7ap_fs_read_file(POLL_LIST_FILE_ID, 0, poll_list_file_cached.bytes, &size, ROOT_AUTH);
+    if (poll_list_file_cached.entry_count == 0) {
+        modbus_poller_plan(NULL, 0);
+        DPRINT("poll list empty, measuring the energy file");
+        return;
+    }
+
+    if (poll_list_file_cached.entry_count <= MODBUS_POLLER_MAX_ENTRIES)
+        for (uint8_t i = 0; i < poll_list_file_cached.entry_count; i++)
+            values_size += 1 + poll_list_file_cached.entries[i].count * poll_list_value_size(&poll_list_file_cached.entries[i]);
+    // the values of every entry have to fit in a single uplink
+    if ((values_size > RAW_POLL_VALUES_FILE_SIZE)
+        || !modbus_poller_plan(poll_list_file_cached.entries, poll_list_file_cached.entry_count)) {
+        log_print_error_string("invalid poll list of %d entries, measuring the energy file", poll_list_file_cached.entry_count);
+        modbus_poller_plan(NULL, 0);
+        return;
+    }
+    poll_list_planned = true;
+}
+
+/**
+ * @brief Initialize the poll list file and the poll values file
+ * The poll list file tells which registers of which slaves get measured instead of the fixed energy file,
+ * the poll values file holds the converted values of the last measurement of that list
+ * @return error_t
+ */
+error_t poll_list_files_initialize()
+{
+    d7ap_fs_file_header_t volatile_file_header
+        = { .file_permissions = (file_permission_t) { .guest_read = true, .user_read = true },
+              .file_properties.storage_class = FS_STORAGE_VOLATILE,
+              .length = POLL_VALUES_FILE_SIZE,
+              .allocated_length = POLL_VALUES_FILE_SIZE };
+
+    d7ap_fs_file_header_t permanent_file_header = { .file_permissions
+        = (file_permission_t) { .guest_read = true, .guest_write = true, .user_read = true, .user_write = true },
+        .file_properties.storage_class = FS_STORAGE_PERMANENT,
+        .length = POLL_LIST_FILE_SIZE,
+        .allocated_length = POLL_LIST_FILE_SIZE };
+
+    uint32_t length = POLL_LIST_FILE_SIZE;
+    error_t ret = d7ap_fs_read_file(POLL_LIST_FILE_ID, 0, poll_list_file_cached.bytes, &length, ROOT_AUTH);
+    if (ret == -ENOENT) {
+        ret = d7ap_fs_init_file(POLL_LIST_FILE_ID, &permanent_file_header, poll_list_file_cached.bytes);
+        if (ret != SUCCESS) {
+            log_print_error_string("Error initializing poll list file: %d", ret);
+            return ret;
+        }
+    } else if (ret != SUCCESS)
+        log_print_error_string("Error reading poll list file: %d", ret);
+
+    ret = d7ap_fs_init_file(POLL_VALUES_FILE_ID, &volatile_file_header, poll_values_file.bytes);
+    if (ret != SUCCESS) {
+        log_print_error_string("Error initializing poll values file: %d", ret);
+    }
+
+    modbus_poller_init();
+    poll_list_load();
+
+    d7ap_fs_register_file_modified_callback(POLL_LIST_FILE_ID, &file_modified_callback);
+    d7ap_fs_register_file_modified_callback(POLL_VALUES_FILE_ID, &file_modified_callback);
+    sched_register_task(&poll_list_measure);
+    DPRINT("poll list file inited");
+    return ret;
+}
+
+static void file_modified_callback(uint8_t file_id)
+{
+    if (file_id == POLL_LIST_FILE_ID) {
+        // poll list got modified, re-plan it unless it is being measured right now
+        if (modbus_poller_is_busy())
+            poll_list_reload = true;
+        else
+            poll_list_load();
+    } else if (file_id == POLL_VALUES_FILE_ID) {
+        // poll values file got modified, most likely internally
+        uint32_t size = POLL_VALUES_FILE_SIZE;
+        d7ap_fs_read_file(POLL_VALUES_FILE_ID, 0, poll_values_file.bytes, &size, ROOT_AUTH);
+        queue_add_file(poll_values_file.bytes, POLL_VALUES_FILE_SIZE, POLL_VALUES_FILE_ID);
+    }
+}
+
+static void poll_list_measurement_done(bool success)
+{
+    uint8_t* block = poll_values_file.blocks;
+
+    poll_values_file.valid_entries = poll_valid_entries;
+    poll_values_file.entry_count = poll_list_file_cached.entry_count;
+    for (uint8_t i = 0, value = 0; i < poll_list_file_cached.entry_count; i++) {
+        const modbus_poll_entry_t* entry = &poll_list_file_cached.entries[i];
+        uint8_t value_size = poll_list_value_size(entry);
+
+        *block++ = entry->count | ((value_size == 8) ? POLL_VALUES_WIDE : 0);
+        for (uint8_t v = 0; v < entry->count; v++, value++) {
+            // little endian, like the rest of the files
+            for (uint8_t b = 0; b < value_size; b++)
+                *block++ = (uint8_t)((uint64_t)poll_values[value] >> (8 * b));
+        }
+    }
+    memset(block, 0, poll_values_file.bytes + POLL_VALUES_FILE_SIZE - block);
+    d7ap_fs_write_file(POLL_VALUES_FILE_ID, 0, poll_values_file.bytes, POLL_VALUES_FILE_SIZE, ROOT_AUTH);
+
+    if (poll_list_reload)
+        poll_list_load();
+    if (poll_list_callback)
+        poll_list_callback(success);
+}
+
+static void poll_list_measure()
+{
+    DPRINT("executing poll list measurement");
+
+    // the poll list got cleared while waiting for the bus, the next measurement falls back to the energy file
+    if (!poll_list_planned) {
+        if (poll_list_callback)
+            poll_list_callback(false);
+        return;
+    }
+    // the bus is still busy with another poll, try again later
+    if (!modbus_poller_poll(poll_values, &poll_valid_entries, &poll_list_measurement_done))
+        timer_post_task_delay(&poll_list_measure, 50);
+}
+
+/**
+ * @brief Measure the poll list in the background
+ * @param callback called once the poll values file got written
+ * @return false if there is no valid poll list, the fixed energy file has to be measured instead
+ */
+bool poll_list_file_execute_measurement(modbus_poller_callback_t callback)
+{
+    if (!poll_list_planned)
+        return false;
+    poll_list_callback = callback;
+    poll_list_measure();
+    return true;
+}
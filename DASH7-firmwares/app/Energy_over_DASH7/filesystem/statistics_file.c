@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include "statistics_file.h"
+#include "d7ap_fs.h"
+#include "errors.h"
+#include "little_queue.h"
+#include "log.h"
+#include "mmodbus.h"
+#include "stdint.h"
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+#define STATISTICS_UPLINK_CYCLES 6 // measurement cycles between two uplinks, an hour at the default interval
+
+#define STATISTICS_FILE_ID 57
+#define STATISTICS_FILE_SIZE sizeof(statistics_file_t)
+#define RAW_STATISTICS_FILE_SIZE (16 + _MMODBUS_STATS_FUNCTIONS * (1 + 2 * _MMODBUS_LATENCY_BUCKETS))
+
+typedef struct {
+    union {
+        uint8_t bytes[RAW_STATISTICS_FILE_SIZE];
+        MModBus_Statistics_t statistics;
+    };
+} statistics_file_t;
+
+static statistics_file_t statistics_file;
+static uint8_t statistics_cycles;
+
+/**
+ * @brief Initialize the statistics file
+ * The statistics file tells how the meter link behaves: the outcome of all transactions since boot and a histogram
+ * of the response times per function code
+ * @return error_t
+ */
+error_t statistics_file_initialize()
+{
+    d7ap_fs_file_header_t volatile_file_header
+        = { .file_permissions = (file_permission_t) { .guest_read = true, .user_read = true },
+              .file_properties.storage_class = FS_STORAGE_VOLATILE,
+              .length = STATISTICS_FILE_SIZE,
+              .allocated_length = STATISTICS_FILE_SIZE };
+
+    error_t ret = d7ap_fs_init_file(STATISTICS_FILE_ID, &volatile_file_header, statistics_file.bytes);
+    if (ret != SUCCESS)
+        log_print_error_string("Error initializing statistics file: %d", ret);
+    DPRINT("statistics file inited");
+    return ret;
+}
+
+/**
+ * @brief Refresh the statistics file, it gets sent along every STATISTICS_UPLINK_CYCLES calls
+ * Called once per measurement cycle, a read of the gateway always gets the state of the last cycle
+ */
+void statistics_file_update()
+{
+    mmodbus_getStatistics(&statistics_file.statistics);
+    d7ap_fs_write_file(STATISTICS_FILE_ID, 0, statistics_file.bytes, STATISTICS_FILE_SIZE, ROOT_AUTH);
+    DPRINT("bus kept the core awake for %d ticks over %d wake-ups", mmodbus_getAwakeTicks(), mmodbus_getWakeups());
+    if (++statistics_cycles < STATISTICS_UPLINK_CYCLES)
+        return;
+    statistics_cycles = 0;
+    queue_add_file(statistics_file.bytes, STATISTICS_FILE_SIZE, STATISTICS_FILE_ID);
+}
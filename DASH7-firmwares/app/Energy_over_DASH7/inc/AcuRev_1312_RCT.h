@@ -26,18 +26,41 @@
 #define __ACUREF_1312_RCT_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "stdbool.h"
 
 
+// called from scheduler context when a request succeeded or failed after all retries
+typedef void (*acurev_callback_t)(bool success);
+// called from scheduler context once the baud rate negotiation finished, 0 if the meter did not answer on any rate
+typedef void (*acurev_baudrate_callback_t)(uint32_t baudrate);
+
+// register map of the quantities that get measured, phase A, B and C follow each other from the first register on
+// the converted value is raw * 10^(scale factor + exponent), all 32 bit registers are in CDAB order
+//  X(name,            first register, width, raw type, scale factor register, exponent, converted type)
+#define ACUREV_QUANTITIES(X)                                          \
+    X(real_energy,     4213,           32,    int32_t,  4219,                  3,        int64_t) \
+    X(apparent_energy, 4230,           32,    int32_t,  4236,                  3,        int64_t) \
+    X(voltage,         4173,           16,    uint16_t, 4180,                  0,        int16_t) \
+    X(current,         4168,           16,    int16_t,  4171,                  3,        int32_t)
+
+#define ACUREV_VALUES_FIELD(name, first, width, raw_type, scale_register, exponent, type) type name[3];
+
+// phase A, B and C of every quantity
+typedef struct {
+    ACUREV_QUANTITIES(ACUREV_VALUES_FIELD)
+} acurev_values_t;
+
 void acurev_1312_rct_init();
-bool acurev_get_real_energy(int64_t *real_energy_a, int64_t *real_energy_b, int64_t *real_energy_c);
-bool acurev_get_apparent_energy(int64_t *apparent_energy_a, int64_t *apparent_energy_b, int64_t *apparent_energy_c);
-bool acurev_get_voltage(int16_t *voltage_a, int16_t *voltage_b, int16_t *voltage_c);
-bool acurev_get_current(int32_t *current_a, int32_t *current_b, int32_t *current_c);
-void acurev_gain_write_permission();
-void acurev_reset_meter_record();
+bool acurev_get_values(uint8_t slave_address, acurev_values_t* values, acurev_callback_t callback);
+bool acurev_gain_write_permission(uint8_t slave_address);
+bool acurev_reset_meter_record(uint8_t slave_address);
+bool acurev_negotiate_baudrate(uint8_t slave_address, uint32_t preferred, uint32_t ceiling, acurev_baudrate_callback_t callback);
+uint32_t acurev_get_lower_baudrate(uint32_t baudrate);
+uint32_t acurev_get_baudrate();
+bool acurev_link_degraded();
 
 
 #endif //__ACUREF_1312_RCT_H
\ No newline at end of file
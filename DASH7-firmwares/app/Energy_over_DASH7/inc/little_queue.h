@@ -39,6 +39,7 @@ typedef enum {
 
 void little_queue_init();
 void queue_add_file(uint8_t* file_content, uint8_t file_size, uint8_t file_id);
+bool queue_has_room(uint8_t file_count, uint8_t file_size);
 void little_queue_set_led_state(bool state);
 
 #endif //__LITTLE_QUEUE_H
\ No newline at end of file
@@ -88,17 +88,137 @@ typedef enum
   
 }MModBus_32bitOrder_t;
 
+typedef enum
+{
+  MModBus_TransactionState_Idle = 0,
+  MModBus_TransactionState_Busy,
+  MModBus_TransactionState_Done,
+  
+}MModBus_TransactionState_t;
+
+typedef enum
+{
+  MModBus_Status_Ok = 0,
+  MModBus_Status_Timeout,
+  MModBus_Status_SendError,
+  MModBus_Status_CrcError,
+  MModBus_Status_WrongSlave,
+  MModBus_Status_WrongFunction,
+  MModBus_Status_InvalidResponse,
+  MModBus_Status_Exception,
+  
+}MModBus_Status_t;
+
+typedef enum
+{
+  MModBus_Exception_None = 0,
+  MModBus_Exception_IllegalFunction = 1,
+  MModBus_Exception_IllegalDataAddress = 2,
+  MModBus_Exception_IllegalDataValue = 3,
+  MModBus_Exception_SlaveDeviceFailure = 4,
+  MModBus_Exception_Acknowledge = 5,
+  MModBus_Exception_SlaveDeviceBusy = 6,
+  MModBus_Exception_MemoryParityError = 8,
+  MModBus_Exception_GatewayPathUnavailable = 10,
+  MModBus_Exception_GatewayTargetFailed = 11,
+  
+}MModBus_Exception_t;
+
+typedef struct MModBus_Transaction_s MModBus_Transaction_t;
+
+//  called from scheduler context once the response is validated or the timeout expired
+typedef void (*MModBus_Callback_t)(MModBus_Transaction_t *transaction);
+//  called from scheduler context with a request of a local master that arrived in between own transactions,
+//  the frame is CRC checked and its length excludes the CRC, answer it with mmodbus_reply
+typedef void (*MModBus_RequestHandler_t)(const uint8_t *frame, uint16_t length);
+
+typedef struct
+{
+  //  0 while the slot is unused
+  uint8_t                             function;
+  uint16_t                            buckets[_MMODBUS_LATENCY_BUCKETS];
+  
+}__attribute__((__packed__)) MModBus_LatencyHistogram_t;
+
+//  all counters saturate instead of wrapping
+typedef struct
+{
+  uint16_t                            requests;
+  uint16_t                            successes;
+  uint16_t                            timeouts;
+  uint16_t                            crcErrors;
+  uint16_t                            exceptions;
+  uint16_t                            overruns;
+  uint16_t                            recovered;
+  uint16_t                            discarded;
+  MModBus_LatencyHistogram_t          latency[_MMODBUS_STATS_FUNCTIONS];
+  
+}__attribute__((__packed__)) MModBus_Statistics_t;
+
+struct MModBus_Transaction_s
+{
+  //  request, filled in by the mmodbus_prepare* functions
+  uint8_t                             txBuf[_MMODBUS_TXSIZE];
+  uint16_t                            txSize;
+  uint16_t                            expectedLength;
+  uint32_t                            timeout;
+  MModBus_Callback_t                  callback;
+  void                                *arg;
+  //  result, filled in by the transaction engine
+  volatile MModBus_TransactionState_t state;
+  bool                                success;
+  MModBus_Status_t                    status;
+  //  exception code of the slave when status is MModBus_Status_Exception
+  uint8_t                             exception;
+  //  payload of the response inside mmodbus.rxBuf, only valid until the next transaction is submitted
+  uint8_t                             *data;
+  uint16_t                            dataLength;
+};
+
 typedef struct
 {
   uint16_t              rxIndex;  
-  uint8_t               rxBuf[_MMODBUS_RXSIZE];
+  //  rxBuf points at the second byte, which aligns the register payload of read responses
+  uint32_t              rxWords[(_MMODBUS_RXSIZE + 4) / 4];
+  uint8_t               *rxBuf;
+  //  timer ticks of the last byte received
   uint32_t              rxTime;
+  //  3.5 character times in timer ticks plus the margin of the timer, the silence that delimits RTU frames
+  uint32_t              silenceTicks;
+  //  a character of 10 bits on the wire, the timeout of a transaction waits for its frames on top
+  uint32_t              charUs;
+  uint16_t              rxCrc;
+  //  length of the frame being received, shortened when the slave answers with an exception
+  uint16_t              rxExpected;
+  //  received bytes that did not fit in rxBuf or arrived outside of a transaction
+  uint32_t              rxOverflow;
+  //  bytes the uart lost because the previous one was not read out in time
+  uint32_t              rxOverrun;
+  //  responses found back inside noise, and the noise bytes dropped around them
+  uint32_t              rxRecovered;
+  uint32_t              rxDiscarded;
+  #if (_MMODBUS_RXDMA == 1)
+  uint16_t              rxDmaEnd;
+  #endif
   uint8_t               txBusy;
+  uint8_t               txError;
+  uint32_t              txTime;
+  //  timer ticks when the request started, the response latency counts from here
+  uint32_t              txTick;
+  MModBus_Statistics_t  stats;
+  //  core time the bus costs: timer ticks spent sending, and the interrupts and tasks that woke it up
+  uint32_t              awakeTicks;
+  uint32_t              wakeups;
   uint32_t              timeout; 
   MModBus_16bitOrder_t  byteOrder16;
   MModBus_32bitOrder_t  byteOrder32;
+  MModBus_Transaction_t *active;
+  MModBus_RequestHandler_t requestHandler;
+  //  receiving requests of a local master, set in between own transactions
+  volatile uint8_t      listening;
+  volatile uint8_t      rxDone;
   #if (_MMODBUS_TXDMA == 1)
-  uint8_t             txDmaDone;
+  volatile uint8_t      txDmaDone;
   #endif  
   
 }MModBus_t;
@@ -107,10 +227,40 @@ typedef struct
 
 void    mmodbus_callback(void);
 void    modbus_callback_stack(uart_handle_t* uart, uint8_t data);
-void    mmodbus_callback_txDMA(void);
+void    mmodbus_callback_DMA(void);
 bool    mmodbus_init(uint32_t setTimeout);
+void    mmodbus_setBaudrate(uint32_t baudrate);
 void    mmodbus_set16bitOrder(MModBus_16bitOrder_t MModBus_16bitOrder_);
 void    mmodbus_set32bitOrder(MModBus_32bitOrder_t MModBus_32bitOrder_);
+//  asynchronous transactions: prepare a request, submit it and get the result in the callback
+bool    mmodbus_prepareRead(MModBus_Transaction_t *transaction, uint8_t slaveAddress, MModbusCMD_t cmd, uint16_t startnumber, uint16_t length);
+bool    mmodbus_prepareWriteSingle(MModBus_Transaction_t *transaction, uint8_t slaveAddress, MModbusCMD_t cmd, uint16_t number, uint16_t data);
+bool    mmodbus_prepareWriteMultipleRegisters(MModBus_Transaction_t *transaction, uint8_t slaveAddress, uint16_t startnumber, uint16_t length, const uint16_t *data);
+bool    mmodbus_submit(MModBus_Transaction_t *transaction);
+bool    mmodbus_execute(MModBus_Transaction_t *transaction);
+bool    mmodbus_isBusy(void);
+uint32_t mmodbus_getRxOverflow(void);
+uint32_t mmodbus_getRxOverrun(void);
+uint32_t mmodbus_getRxRecovered(void);
+uint32_t mmodbus_getRxDiscarded(void);
+void    mmodbus_getStatistics(MModBus_Statistics_t *stats);
+void    mmodbus_resetStatistics(void);
+uint32_t mmodbus_getAwakeTicks(void);
+uint32_t mmodbus_getWakeups(void);
+uint32_t mmodbus_getSilenceLeft(void);
+uint32_t mmodbus_getTxTick(void);
+bool    mmodbus_isPermanentError(const MModBus_Transaction_t *transaction);
+uint16_t mmodbus_crc16(const uint8_t *nData, uint16_t wLength);
+//  slave personality on the same bus
+void    mmodbus_setRequestHandler(MModBus_RequestHandler_t handler);
+bool    mmodbus_reply(uint8_t *data, uint16_t size);
+//  first is the register offset inside the response, length counts 16 or 32 bit values
+bool    mmodbus_getRegisterRange16i(const MModBus_Transaction_t *transaction, uint16_t first, uint16_t length, uint16_t *data);
+bool    mmodbus_getRegisterRange32i(const MModBus_Transaction_t *transaction, uint16_t first, uint16_t length, uint32_t *data);
+void    mmodbus_getRegisters8i(const MModBus_Transaction_t *transaction, uint8_t *data);
+void    mmodbus_getRegisters16i(const MModBus_Transaction_t *transaction, uint16_t *data);
+void    mmodbus_getRegisters32i(const MModBus_Transaction_t *transaction, uint32_t *data);
+void    mmodbus_getRegisters32f(const MModBus_Transaction_t *transaction, float *data);
 //  coils numbers 00001 to 09999
 bool    mmodbus_readCoil(uint8_t slaveAddress, uint16_t number, uint8_t *data);
 bool    mmodbus_readCoils(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint8_t *data);
@@ -1,20 +1,75 @@
 #ifndef _MMODBUS_CONFIG_H_
 #define _MMODBUS_CONFIG_H_
 
+#include "ports.h"
+
 #define _MMODBUS_FREERTOS         0
 #define _MMODBUS_RTU              1
 #define _MMODBUS_ASCII            0 //  not implemented yet
 #define _MMODBUS_USART            USART1             
-#define _MMODBUS_RXSIZE           64  
+//  the frame delimiting silence is derived from the baudrate, use mmodbus_setBaudrate when the uart runs at another speed
+#define _MMODBUS_BAUDRATE         19200
+//  256 bytes hold the largest RTU response, 125 registers, smaller buffers limit the length of a single read
+#define _MMODBUS_RXSIZE           256
+#define _MMODBUS_TXSIZE           32
+//  CRC-16 backend: table costs 512 bytes of flash, slice4 another 1.5k but handles 4 bytes per step,
+//  hw moves the block CRC to the STM32 CRC unit and drops the tables. The host benchmark builds every backend
+#define _MMODBUS_CRC_TABLE        0
+#define _MMODBUS_CRC_SLICE4       1
+#define _MMODBUS_CRC_HW           2
+#ifndef _MMODBUS_CRC
+#define _MMODBUS_CRC              _MMODBUS_CRC_TABLE
+#endif
+//  statistics keep a latency histogram for this many function codes, in the order they first get used,
+//  the buckets end at these response times in ms, the last bucket holds all slower responses
+#define _MMODBUS_STATS_FUNCTIONS  4
+#define _MMODBUS_LATENCY_BUCKETS  6
+#define _MMODBUS_LATENCY_LIMITS   { 10, 20, 50, 100, 200 }
+//  let the scheduler stop the core while waiting for a response or a request of a local master: the uart runs
+//  from HSI16, which it switches on by itself on a start bit, and every received byte wakes the core up again.
+//  The DMA does not run in stop mode, frames then move byte by byte through the uart interrupt. Off by default so
+//  the DMA carries the frames, the MODBUS_STOPMODE option of the app turns it on
+#ifndef _MMODBUS_STOPMODE
+#define _MMODBUS_STOPMODE         0
+#endif
+#define _MMODBUS_USART_CLKSOURCE  LL_RCC_USART1_CLKSOURCE_HSI
+//  stream a trace of every byte on the bus with a us timestamp over RTT, see modbus_capture.h.
+//  The byte interrupts take the timestamps, the DMA stays off while capturing
+#define _MMODBUS_CAPTURE          0
+//  the DMA channels are selected per board next to the uart port in ports.h
+#if     defined(UART0_DMA_TX_CHANNEL) && (_MMODBUS_STOPMODE == 0) && (_MMODBUS_CAPTURE == 0)
+#define _MMODBUS_TXDMA            1
+#else
 #define _MMODBUS_TXDMA            0
-#if     _MMODBUS_TXDMA == 1
-#define _MMODBUS_DMA              DMA2
-#define _MMODBUS_DMASTREAM        LL_DMA_STREAM_7   
 #endif
-// #define _MMODBUS_CTRL_GPIO        RS485_CTRL_GPIO_Port
-// #define _MMODBUS_CTRL_PIN         RS485_CTRL_Pin
+#if     defined(UART0_DMA_RX_CHANNEL) && (_MMODBUS_STOPMODE == 0) && (_MMODBUS_CAPTURE == 0)
+#define _MMODBUS_RXDMA            1
+#else
+#define _MMODBUS_RXDMA            0
+#endif
+#if     (_MMODBUS_TXDMA == 1) || (_MMODBUS_RXDMA == 1)
+#define _MMODBUS_DMA              DMA1
+#define _MMODBUS_DMA_TXCHANNEL    UART0_DMA_TX_CHANNEL
+#define _MMODBUS_DMA_RXCHANNEL    UART0_DMA_RX_CHANNEL
+#define _MMODBUS_DMA_REQUEST      UART0_DMA_REQUEST
+#define _MMODBUS_DMA_IRQn         UART0_DMA_IRQn
+#define _MMODBUS_DMA_IRQHandler   UART0_DMA_IRQHandler
+#endif
+//  the uart switches the RS485 driver itself when the board routes its DE output to a pin, see ports.h
+#if     defined(UART0_DE_PIN)
+#define _MMODBUS_DE               1
+#define _MMODBUS_DE_PIN           UART0_DE_PIN
+#define _MMODBUS_DE_ALTERNATE     UART0_DE_ALTERNATE
+#define _MMODBUS_DE_ASSERTION     UART0_DE_ASSERTION_TIME
+#define _MMODBUS_DE_DEASSERTION   UART0_DE_DEASSERTION_TIME
+#else
+#define _MMODBUS_DE               0
+#endif
 
 
+#if (_MMODBUS_CRC != _MMODBUS_CRC_TABLE) && (_MMODBUS_CRC != _MMODBUS_CRC_SLICE4) && (_MMODBUS_CRC != _MMODBUS_CRC_HW)
+#error please select _MMODBUS_CRC_TABLE, _MMODBUS_CRC_SLICE4 or _MMODBUS_CRC_HW
+#endif
 #if (_MMODBUS_RTU == 1) && (_MMODBUS_ASCII == 1)
 #error please select _MMODBUS_RTU or _MMODBUS_ASCII
 #endif
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Standard workloads that measure how fast the node pulls registers from a meter, on the target or in the simulator
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_BENCH_H
+#define __MODBUS_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MODBUS_BENCH_MAX_SAMPLES 100
+// the workloads read from the start of the AcuRev measurement registers on
+#define MODBUS_BENCH_FIRST_REGISTER 4160
+
+typedef enum {
+    MODBUS_BENCH_SINGLE = 0, // a single register per transaction
+    MODBUS_BENCH_BLOCK4 = 1, // 4 registers per transaction, like a 64 bit value
+    MODBUS_BENCH_BLOCK125 = 2, // the largest read modbus allows
+    MODBUS_BENCH_CYCLE = 3, // a full measurement of energy, voltage and current, like every interval does
+    MODBUS_BENCH_WORKLOAD_COUNT
+} modbus_bench_workload_t;
+
+// a sample is a transaction, or a whole measurement for MODBUS_BENCH_CYCLE, all times are in timer ticks
+typedef struct {
+    uint8_t workload; // modbus_bench_workload_t
+    uint16_t samples;
+    uint16_t failures;
+    uint32_t transactions; // including the retries
+    uint32_t registers; // read by the samples that succeeded
+    uint32_t elapsed; // from the start of the first sample to the end of the last
+    uint32_t latency_p50;
+    uint32_t latency_p99;
+    uint32_t awake; // the core spent on the bus, as counted by mmodbus
+} modbus_bench_result_t;
+
+// called from scheduler context once all samples of a workload are done
+typedef void (*modbus_bench_callback_t)(const modbus_bench_result_t* result);
+
+void modbus_bench_init();
+bool modbus_bench_run(uint8_t slave_address, modbus_bench_workload_t workload, uint16_t samples,
+    modbus_bench_callback_t callback);
+const char* modbus_bench_workload_name(modbus_bench_workload_t workload);
+bool modbus_bench_start_suite(uint8_t slave_address, bool sweep);
+
+#endif //__MODBUS_BENCH_H
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Shares the bus between the drivers, the most urgent queued transaction goes first
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_BUS_H
+#define __MODBUS_BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mmodbus.h"
+
+// every driver has at most a single transaction queued or running
+#define MODBUS_BUS_MAX_QUEUED 8
+#define MODBUS_BUS_NO_DEADLINE 0
+
+typedef enum {
+    MODBUS_BUS_PRIORITY_POLL = 0, // periodic measurements and scans
+    MODBUS_BUS_PRIORITY_CONFIG = 1, // settings of the meters, like the reset sequence and the baud rate
+    MODBUS_BUS_PRIORITY_URGENT = 2, // requests of the gateway that wait for an answer
+} modbus_bus_priority_t;
+
+void modbus_bus_init(uint32_t baudrate, uint32_t timeout);
+void modbus_bus_set_baudrate(uint32_t baudrate);
+bool modbus_bus_submit(MModBus_Transaction_t* transaction, modbus_bus_priority_t priority, uint32_t deadline);
+bool modbus_bus_is_idle();
+
+#endif //__MODBUS_BUS_H
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Timestamped trace of every byte on the modbus line, streamed over RTT for tools/modbus_capture.py
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_CAPTURE_H
+#define __MODBUS_CAPTURE_H
+
+#include <stdint.h>
+
+// RTT channel 0 carries the log, the trace gets its own channel so it can be recorded on its own
+#define MODBUS_CAPTURE_RTT_CHANNEL 1
+#define MODBUS_CAPTURE_BUFFER_SIZE 1024
+
+// every record is 6 bytes: the type, a little endian timestamp in us and a value
+typedef enum {
+    MODBUS_CAPTURE_TX_BYTE = 1, // value: the byte, stamped when it got handed to the uart
+    MODBUS_CAPTURE_RX_BYTE = 2, // value: the byte, stamped in the receive interrupt
+    MODBUS_CAPTURE_TX_START = 3, // value: the first byte of the frame
+    MODBUS_CAPTURE_TX_END = 4, // value: 0, stamped once the stop bit of the last byte is out
+    MODBUS_CAPTURE_RESPONSE_END = 5, // value: MModBus_Status_t of the transaction
+    MODBUS_CAPTURE_REQUEST_END = 6, // a request of a local master ended, value: its length
+    MODBUS_CAPTURE_LOST = 7, // value: records that did not fit in the RTT buffer since the previous one
+} modbus_capture_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint32_t timestamp;
+    uint8_t value;
+} __attribute__((__packed__)) modbus_capture_record_t;
+
+void modbus_capture_init();
+void modbus_capture_record(uint8_t type, uint8_t value);
+
+#endif //__MODBUS_CAPTURE_H
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Scans the bus for slaves that answer and tells which meters they are
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_DISCOVERY_H
+#define __MODBUS_DISCOVERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    MODBUS_METER_TYPE_UNKNOWN = 0, // answers, but not like any of the known meters
+    MODBUS_METER_TYPE_ACUREV_1312 = 1,
+} modbus_meter_type_t;
+
+typedef struct {
+    uint8_t address;
+    uint8_t type; // modbus_meter_type_t
+    uint8_t latency; // ms from sending the probe until its answer got handled
+    uint32_t baudrate; // rate the slave answered at
+} __attribute__((__packed__)) modbus_discovery_device_t;
+
+// called from scheduler context once the scan finished
+typedef void (*modbus_discovery_callback_t)(uint8_t device_count);
+
+void modbus_discovery_init();
+bool modbus_discovery_scan(uint8_t first_address, uint8_t last_address, modbus_discovery_device_t* devices,
+    uint8_t max_devices, modbus_discovery_callback_t callback);
+
+#endif //__MODBUS_DISCOVERY_H
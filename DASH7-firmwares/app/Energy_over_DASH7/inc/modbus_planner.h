@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Merges wanted register ranges into as few read transactions as possible
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_PLANNER_H
+#define __MODBUS_PLANNER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MODBUS_PLANNER_MAX_RANGES 16
+#define MODBUS_PLANNER_MAX_REGISTERS 125 // the byte count of a read response limits it to 125 registers
+
+typedef struct {
+    uint16_t start;
+    uint16_t length;
+} modbus_range_t;
+
+typedef struct {
+    modbus_range_t reads[MODBUS_PLANNER_MAX_RANGES];
+    uint8_t read_count;
+    uint8_t range_read[MODBUS_PLANNER_MAX_RANGES]; // the read that holds each wanted range
+} modbus_plan_t;
+
+bool modbus_planner_plan(const modbus_range_t* ranges, uint8_t range_count, uint16_t max_gap, modbus_plan_t* plan);
+uint16_t modbus_planner_range_offset(const modbus_plan_t* plan, const modbus_range_t* ranges, uint8_t range);
+
+// multiply a value decoded from a planned read by 10^exponent, negative exponents truncate towards zero.
+// Inline, the drivers call it per value with an exponent that is often known at compile time
+static inline int64_t modbus_planner_scale(int64_t value, int16_t exponent)
+{
+    for (; exponent > 0; exponent--)
+        value *= 10;
+    for (; exponent < 0; exponent++)
+        value /= 10;
+    return value;
+}
+
+#endif //__MODBUS_PLANNER_H
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Polls a list of register blocks that is only known at runtime
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_POLLER_H
+#define __MODBUS_POLLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MODBUS_POLLER_MAX_ENTRIES 8
+#define MODBUS_POLLER_MAX_VALUES 16
+#define MODBUS_POLLER_NO_SCALE_REGISTER 0xFFFF
+
+// 32 bit values follow the word order that is configured in mmodbus
+typedef enum {
+    MODBUS_POLL_TYPE_UINT16 = 0,
+    MODBUS_POLL_TYPE_INT16 = 1,
+    MODBUS_POLL_TYPE_UINT32 = 2,
+    MODBUS_POLL_TYPE_INT32 = 3,
+    MODBUS_POLL_TYPE_COUNT
+} modbus_poll_type_t;
+
+// a block of values that gets converted to raw * 10^(scale factor + exponent)
+typedef struct {
+    uint8_t slave;
+    uint16_t start_register;
+    uint8_t count; // number of values, not registers
+    uint8_t type; // modbus_poll_type_t
+    uint16_t scale_register; // signed scale factor of the block, MODBUS_POLLER_NO_SCALE_REGISTER to only use the exponent
+    int8_t exponent;
+} __attribute__((__packed__)) modbus_poll_entry_t;
+
+// called from scheduler context once all reads are done, false if any of them failed
+typedef void (*modbus_poller_callback_t)(bool success);
+
+void modbus_poller_init();
+bool modbus_poller_plan(const modbus_poll_entry_t* entries, uint8_t entry_count);
+bool modbus_poller_poll(int64_t* values, uint8_t* valid_entries, modbus_poller_callback_t callback);
+bool modbus_poller_is_busy();
+uint8_t modbus_poller_type_width(uint8_t type);
+
+#endif //__MODBUS_POLLER_H
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Answers the register reads of a local master from a cached register image
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __MODBUS_SLAVE_H
+#define __MODBUS_SLAVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// register 0 holds the seconds since the image got refreshed, 0xFFFF before the first refresh
+#define MODBUS_SLAVE_AGE_REGISTER 0
+#define MODBUS_SLAVE_REGISTER_COUNT 140
+
+void modbus_slave_init();
+bool modbus_slave_set_address(uint8_t address);
+void modbus_slave_write_registers(uint16_t first_register, const uint16_t* registers, uint16_t count);
+void modbus_slave_refreshed();
+
+#endif //__MODBUS_SLAVE_H
@@ -132,6 +132,17 @@ void queue_add_file(uint8_t* file_content, uint8_t file_size, uint8_t file_id)
         sched_post_task(&queue_transmit_files);
 }
 
+/**
+ * @brief Check if files still fit in the queue, producers that run at their own pace back off when they do not
+ * @param file_count number of files that have to fit
+ * @param file_size size of every one of them
+ */
+bool queue_has_room(uint8_t file_count, uint8_t file_size)
+{
+    return (fifo_get_size(&file_fifo) + file_count * file_size <= sizeof(file_fifo_buffer))
+        && (fifo_get_size(&file_size_and_id_fifo) + file_count * 2 <= sizeof(file_size_and_id_fifo_buffer));
+}
+
 /**
  * @brief Initializes the queueing and transmission process
  */
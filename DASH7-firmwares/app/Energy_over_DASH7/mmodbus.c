@@ -4,10 +4,90 @@
 #include "stm32_device.h"
 #include "log.h"
 #include "hwsystem.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "hwatomic.h"
+#if (_MMODBUS_CRC == _MMODBUS_CRC_HW)
+#include "stm32l0xx_ll_bus.h"
+#include "stm32l0xx_ll_crc.h"
+#endif
+#if (_MMODBUS_STOPMODE == 1)
+#include "stm32l0xx_ll_rcc.h"
+#endif
+#if (_MMODBUS_DE == 1)
+#include "hwgpio.h"
+#include "stm32_common_gpio.h"
+#endif
+#if (_MMODBUS_CAPTURE == 1)
+#include "modbus_capture.h"
+#define mmodbus_capture(type, value)  modbus_capture_record(type, value)
+#else
+#define mmodbus_capture(type, value)
+#endif
+#if (_MMODBUS_TXDMA == 1) || (_MMODBUS_RXDMA == 1)
+#include "stm32l0xx_ll_dma.h"
+
+// the DMA1 interrupt flags of channel x are found at bit offset (x - 1) * 4
+#define mmodbus_dmaFlag(flag, channel)  ((flag) << (((channel) - 1) * 4))
+#endif
+
+#define mmodbus_msToTicks(ms)   (((ms) * TIMER_TICKS_PER_SEC) / 1000)
+#define mmodbus_ticksToMs(ticks)  (((ticks) * 1000) / TIMER_TICKS_PER_SEC)
+#define mmodbus_saturate(count) ((count) < 0xFFFF ? (count) : 0xFFFF)
+#define mmodbus_countUp(counter)  ((counter) = mmodbus_saturate((uint32_t)(counter) + 1))
+
+static const uint16_t mmodbus_latencyLimits[_MMODBUS_LATENCY_BUCKETS - 1] = _MMODBUS_LATENCY_LIMITS;
+// the shortest response: address, function code | 0x80, exception code and CRC
+#define mmodbus_exceptionSize   5
+#define mmodbus_exceptionFunction(cmd)  ((cmd) | 0x80)
+
 MModBus_t mmodbus;
 
+static void mmodbus_transactionTask(void *arg);
+static void mmodbus_silenceTask(void *arg);
+static void mmodbus_requestTask(void *arg);
+static void mmodbus_wakeupTask(void *arg);
+#if (_MMODBUS_RXDMA == 1)
+static void mmodbus_armRxDMA(uint16_t offset, uint16_t length);
+#endif
+
 //#####################################################################################################
 #if( _MMODBUS_RTU == 1)
+#if (_MMODBUS_CRC == _MMODBUS_CRC_HW)
+//  the CRC unit of the STM32L0 runs the MODBUS polynomial with reflected in- and output, the byte per byte
+//  update in the RX interrupt shifts bitwise so neither path needs a table in flash
+static inline uint16_t mmodbus_crc16Update(uint16_t wCRCWord, uint8_t nData)
+{
+  wCRCWord ^= nData;
+  for(uint8_t i = 0; i < 8; i++)
+    wCRCWord = (wCRCWord & 0x0001) ? ((wCRCWord >> 1) ^ 0xA001) : (wCRCWord >> 1);
+  return wCRCWord;
+}
+static void mmodbus_crc16Init(void)
+{
+  LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_CRC);
+  LL_CRC_SetPolynomialSize(CRC, LL_CRC_POLYLENGTH_16B);
+  LL_CRC_SetPolynomialCoef(CRC, 0x8005);
+  LL_CRC_SetInitialData(CRC, 0xFFFF);
+  LL_CRC_SetInputDataReverseMode(CRC, LL_CRC_INDATA_REVERSE_BYTE);
+  LL_CRC_SetOutputDataReverseMode(CRC, LL_CRC_OUTDATA_REVERSE_BIT);
+}
+uint16_t mmodbus_crc16(const uint8_t *nData, uint16_t wLength)
+{
+  uint16_t wCRCWord;
+  //  the unit is shared between the transaction preparation and the DMA interrupt
+  start_atomic();
+  LL_CRC_ResetCRCCalculationUnit(CRC);
+  //  a word is processed from its most significant byte on, so put the first byte on top
+  for(; wLength >= 4; wLength -= 4, nData += 4)
+    LL_CRC_FeedData32(CRC, ((uint32_t)nData[0] << 24) | ((uint32_t)nData[1] << 16) | ((uint32_t)nData[2] << 8) | nData[3]);
+  while (wLength--)
+    LL_CRC_FeedData8(CRC, *nData++);
+  wCRCWord = LL_CRC_ReadData16(CRC);
+  end_atomic();
+  return wCRCWord;
+}
+#else
 static const uint16_t wCRCTable[] =
 {
   0X0000, 0XC0C1, 0XC181, 0X0140, 0XC301, 0X03C0, 0X0280, 0XC241,
@@ -43,178 +123,561 @@ static const uint16_t wCRCTable[] =
   0X4400, 0X84C1, 0X8581, 0X4540, 0X8701, 0X47C0, 0X4680, 0X8641,
   0X8201, 0X42C0, 0X4380, 0X8341, 0X4100, 0X81C1, 0X8081, 0X4040 
 };
+static inline uint16_t mmodbus_crc16Update(uint16_t wCRCWord, uint8_t nData)
+{
+  uint8_t nTemp = nData ^ wCRCWord;
+  wCRCWord >>= 8;
+  wCRCWord  ^= wCRCTable[nTemp];
+  return wCRCWord;
+}
+static void mmodbus_crc16Init(void)
+{
+}
+#if (_MMODBUS_CRC == _MMODBUS_CRC_SLICE4)
+//  wCRCSliceTable[k - 1][n] is the CRC of byte n followed by k zero bytes
+static const uint16_t wCRCSliceTable[3][256] =
+{
+  {
+    0X0000, 0X9001, 0X6001, 0XF000, 0XC002, 0X5003, 0XA003, 0X3002,
+    0XC007, 0X5006, 0XA006, 0X3007, 0X0005, 0X9004, 0X6004, 0XF005,
+    0XC00D, 0X500C, 0XA00C, 0X300D, 0X000F, 0X900E, 0X600E, 0XF00F,
+    0X000A, 0X900B, 0X600B, 0XF00A, 0XC008, 0X5009, 0XA009, 0X3008,
+    0XC019, 0X5018, 0XA018, 0X3019, 0X001B, 0X901A, 0X601A, 0XF01B,
+    0X001E, 0X901F, 0X601F, 0XF01E, 0XC01C, 0X501D, 0XA01D, 0X301C,
+    0X0014, 0X9015, 0X6015, 0XF014, 0XC016, 0X5017, 0XA017, 0X3016,
+    0XC013, 0X5012, 0XA012, 0X3013, 0X0011, 0X9010, 0X6010, 0XF011,
+    0XC031, 0X5030, 0XA030, 0X3031, 0X0033, 0X9032, 0X6032, 0XF033,
+    0X0036, 0X9037, 0X6037, 0XF036, 0XC034, 0X5035, 0XA035, 0X3034,
+    0X003C, 0X903D, 0X603D, 0XF03C, 0XC03E, 0X503F, 0XA03F, 0X303E,
+    0XC03B, 0X503A, 0XA03A, 0X303B, 0X0039, 0X9038, 0X6038, 0XF039,
+    0X0028, 0X9029, 0X6029, 0XF028, 0XC02A, 0X502B, 0XA02B, 0X302A,
+    0XC02F, 0X502E, 0XA02E, 0X302F, 0X002D, 0X902C, 0X602C, 0XF02D,
+    0XC025, 0X5024, 0XA024, 0X3025, 0X0027, 0X9026, 0X6026, 0XF027,
+    0X0022, 0X9023, 0X6023, 0XF022, 0XC020, 0X5021, 0XA021, 0X3020,
+    0XC061, 0X5060, 0XA060, 0X3061, 0X0063, 0X9062, 0X6062, 0XF063,
+    0X0066, 0X9067, 0X6067, 0XF066, 0XC064, 0X5065, 0XA065, 0X3064,
+    0X006C, 0X906D, 0X606D, 0XF06C, 0XC06E, 0X506F, 0XA06F, 0X306E,
+    0XC06B, 0X506A, 0XA06A, 0X306B, 0X0069, 0X9068, 0X6068, 0XF069,
+    0X0078, 0X9079, 0X6079, 0XF078, 0XC07A, 0X507B, 0XA07B, 0X307A,
+    0XC07F, 0X507E, 0XA07E, 0X307F, 0X007D, 0X907C, 0X607C, 0XF07D,
+    0XC075, 0X5074, 0XA074, 0X3075, 0X0077, 0X9076, 0X6076, 0XF077,
+    0X0072, 0X9073, 0X6073, 0XF072, 0XC070, 0X5071, 0XA071, 0X3070,
+    0X0050, 0X9051, 0X6051, 0XF050, 0XC052, 0X5053, 0XA053, 0X3052,
+    0XC057, 0X5056, 0XA056, 0X3057, 0X0055, 0X9054, 0X6054, 0XF055,
+    0XC05D, 0X505C, 0XA05C, 0X305D, 0X005F, 0X905E, 0X605E, 0XF05F,
+    0X005A, 0X905B, 0X605B, 0XF05A, 0XC058, 0X5059, 0XA059, 0X3058,
+    0XC049, 0X5048, 0XA048, 0X3049, 0X004B, 0X904A, 0X604A, 0XF04B,
+    0X004E, 0X904F, 0X604F, 0XF04E, 0XC04C, 0X504D, 0XA04D, 0X304C,
+    0X0044, 0X9045, 0X6045, 0XF044, 0XC046, 0X5047, 0XA047, 0X3046,
+    0XC043, 0X5042, 0XA042, 0X3043, 0X0041, 0X9040, 0X6040, 0XF041
+  },
+  {
+    0X0000, 0XC051, 0XC0A1, 0X00F0, 0XC141, 0X0110, 0X01E0, 0XC1B1,
+    0XC281, 0X02D0, 0X0220, 0XC271, 0X03C0, 0XC391, 0XC361, 0X0330,
+    0XC501, 0X0550, 0X05A0, 0XC5F1, 0X0440, 0XC411, 0XC4E1, 0X04B0,
+    0X0780, 0XC7D1, 0XC721, 0X0770, 0XC6C1, 0X0690, 0X0660, 0XC631,
+    0XCA01, 0X0A50, 0X0AA0, 0XCAF1, 0X0B40, 0XCB11, 0XCBE1, 0X0BB0,
+    0X0880, 0XC8D1, 0XC821, 0X0870, 0XC9C1, 0X0990, 0X0960, 0XC931,
+    0X0F00, 0XCF51, 0XCFA1, 0X0FF0, 0XCE41, 0X0E10, 0X0EE0, 0XCEB1,
+    0XCD81, 0X0DD0, 0X0D20, 0XCD71, 0X0CC0, 0XCC91, 0XCC61, 0X0C30,
+    0XD401, 0X1450, 0X14A0, 0XD4F1, 0X1540, 0XD511, 0XD5E1, 0X15B0,
+    0X1680, 0XD6D1, 0XD621, 0X1670, 0XD7C1, 0X1790, 0X1760, 0XD731,
+    0X1100, 0XD151, 0XD1A1, 0X11F0, 0XD041, 0X1010, 0X10E0, 0XD0B1,
+    0XD381, 0X13D0, 0X1320, 0XD371, 0X12C0, 0XD291, 0XD261, 0X1230,
+    0X1E00, 0XDE51, 0XDEA1, 0X1EF0, 0XDF41, 0X1F10, 0X1FE0, 0XDFB1,
+    0XDC81, 0X1CD0, 0X1C20, 0XDC71, 0X1DC0, 0XDD91, 0XDD61, 0X1D30,
+    0XDB01, 0X1B50, 0X1BA0, 0XDBF1, 0X1A40, 0XDA11, 0XDAE1, 0X1AB0,
+    0X1980, 0XD9D1, 0XD921, 0X1970, 0XD8C1, 0X1890, 0X1860, 0XD831,
+    0XE801, 0X2850, 0X28A0, 0XE8F1, 0X2940, 0XE911, 0XE9E1, 0X29B0,
+    0X2A80, 0XEAD1, 0XEA21, 0X2A70, 0XEBC1, 0X2B90, 0X2B60, 0XEB31,
+    0X2D00, 0XED51, 0XEDA1, 0X2DF0, 0XEC41, 0X2C10, 0X2CE0, 0XECB1,
+    0XEF81, 0X2FD0, 0X2F20, 0XEF71, 0X2EC0, 0XEE91, 0XEE61, 0X2E30,
+    0X2200, 0XE251, 0XE2A1, 0X22F0, 0XE341, 0X2310, 0X23E0, 0XE3B1,
+    0XE081, 0X20D0, 0X2020, 0XE071, 0X21C0, 0XE191, 0XE161, 0X2130,
+    0XE701, 0X2750, 0X27A0, 0XE7F1, 0X2640, 0XE611, 0XE6E1, 0X26B0,
+    0X2580, 0XE5D1, 0XE521, 0X2570, 0XE4C1, 0X2490, 0X2460, 0XE431,
+    0X3C00, 0XFC51, 0XFCA1, 0X3CF0, 0XFD41, 0X3D10, 0X3DE0, 0XFDB1,
+    0XFE81, 0X3ED0, 0X3E20, 0XFE71, 0X3FC0, 0XFF91, 0XFF61, 0X3F30,
+    0XF901, 0X3950, 0X39A0, 0XF9F1, 0X3840, 0XF811, 0XF8E1, 0X38B0,
+    0X3B80, 0XFBD1, 0XFB21, 0X3B70, 0XFAC1, 0X3A90, 0X3A60, 0XFA31,
+    0XF601, 0X3650, 0X36A0, 0XF6F1, 0X3740, 0XF711, 0XF7E1, 0X37B0,
+    0X3480, 0XF4D1, 0XF421, 0X3470, 0XF5C1, 0X3590, 0X3560, 0XF531,
+    0X3300, 0XF351, 0XF3A1, 0X33F0, 0XF241, 0X3210, 0X32E0, 0XF2B1,
+    0XF181, 0X31D0, 0X3120, 0XF171, 0X30C0, 0XF091, 0XF061, 0X3030
+  },
+  {
+    0X0000, 0XFC01, 0XB801, 0X4400, 0X3001, 0XCC00, 0X8800, 0X7401,
+    0X6002, 0X9C03, 0XD803, 0X2402, 0X5003, 0XAC02, 0XE802, 0X1403,
+    0XC004, 0X3C05, 0X7805, 0X8404, 0XF005, 0X0C04, 0X4804, 0XB405,
+    0XA006, 0X5C07, 0X1807, 0XE406, 0X9007, 0X6C06, 0X2806, 0XD407,
+    0XC00B, 0X3C0A, 0X780A, 0X840B, 0XF00A, 0X0C0B, 0X480B, 0XB40A,
+    0XA009, 0X5C08, 0X1808, 0XE409, 0X9008, 0X6C09, 0X2809, 0XD408,
+    0X000F, 0XFC0E, 0XB80E, 0X440F, 0X300E, 0XCC0F, 0X880F, 0X740E,
+    0X600D, 0X9C0C, 0XD80C, 0X240D, 0X500C, 0XAC0D, 0XE80D, 0X140C,
+    0XC015, 0X3C14, 0X7814, 0X8415, 0XF014, 0X0C15, 0X4815, 0XB414,
+    0XA017, 0X5C16, 0X1816, 0XE417, 0X9016, 0X6C17, 0X2817, 0XD416,
+    0X0011, 0XFC10, 0XB810, 0X4411, 0X3010, 0XCC11, 0X8811, 0X7410,
+    0X6013, 0X9C12, 0XD812, 0X2413, 0X5012, 0XAC13, 0XE813, 0X1412,
+    0X001E, 0XFC1F, 0XB81F, 0X441E, 0X301F, 0XCC1E, 0X881E, 0X741F,
+    0X601C, 0X9C1D, 0XD81D, 0X241C, 0X501D, 0XAC1C, 0XE81C, 0X141D,
+    0XC01A, 0X3C1B, 0X781B, 0X841A, 0XF01B, 0X0C1A, 0X481A, 0XB41B,
+    0XA018, 0X5C19, 0X1819, 0XE418, 0X9019, 0X6C18, 0X2818, 0XD419,
+    0XC029, 0X3C28, 0X7828, 0X8429, 0XF028, 0X0C29, 0X4829, 0XB428,
+    0XA02B, 0X5C2A, 0X182A, 0XE42B, 0X902A, 0X6C2B, 0X282B, 0XD42A,
+    0X002D, 0XFC2C, 0XB82C, 0X442D, 0X302C, 0XCC2D, 0X882D, 0X742C,
+    0X602F, 0X9C2E, 0XD82E, 0X242F, 0X502E, 0XAC2F, 0XE82F, 0X142E,
+    0X0022, 0XFC23, 0XB823, 0X4422, 0X3023, 0XCC22, 0X8822, 0X7423,
+    0X6020, 0X9C21, 0XD821, 0X2420, 0X5021, 0XAC20, 0XE820, 0X1421,
+    0XC026, 0X3C27, 0X7827, 0X8426, 0XF027, 0X0C26, 0X4826, 0XB427,
+    0XA024, 0X5C25, 0X1825, 0XE424, 0X9025, 0X6C24, 0X2824, 0XD425,
+    0X003C, 0XFC3D, 0XB83D, 0X443C, 0X303D, 0XCC3C, 0X883C, 0X743D,
+    0X603E, 0X9C3F, 0XD83F, 0X243E, 0X503F, 0XAC3E, 0XE83E, 0X143F,
+    0XC038, 0X3C39, 0X7839, 0X8438, 0XF039, 0X0C38, 0X4838, 0XB439,
+    0XA03A, 0X5C3B, 0X183B, 0XE43A, 0X903B, 0X6C3A, 0X283A, 0XD43B,
+    0XC037, 0X3C36, 0X7836, 0X8437, 0XF036, 0X0C37, 0X4837, 0XB436,
+    0XA035, 0X5C34, 0X1834, 0XE435, 0X9034, 0X6C35, 0X2835, 0XD434,
+    0X0033, 0XFC32, 0XB832, 0X4433, 0X3032, 0XCC33, 0X8833, 0X7432,
+    0X6031, 0X9C30, 0XD830, 0X2431, 0X5030, 0XAC31, 0XE831, 0X1430
+  }
+};
 uint16_t mmodbus_crc16(const uint8_t *nData, uint16_t wLength)
 {
-  uint8_t nTemp;
   uint16_t wCRCWord = 0xFFFF;
-  while (wLength--)
+  uint16_t nTemp;
+  for(; wLength >= 4; wLength -= 4, nData += 4)
   {
-    nTemp = *nData++ ^ wCRCWord;
-    wCRCWord >>= 8;
-    wCRCWord  ^= wCRCTable[nTemp];
+    nTemp = wCRCWord ^ (nData[0] | (nData[1] << 8));
+    wCRCWord = wCRCSliceTable[2][nTemp & 0xFF] ^ wCRCSliceTable[1][nTemp >> 8] ^ wCRCSliceTable[0][nData[2]] ^ wCRCTable[nData[3]];
   }
+  while (wLength--)
+    wCRCWord = mmodbus_crc16Update(wCRCWord, *nData++);
+  return wCRCWord;
+}
+#else
+uint16_t mmodbus_crc16(const uint8_t *nData, uint16_t wLength)
+{
+  uint16_t wCRCWord = 0xFFFF;
+  while (wLength--)
+    wCRCWord = mmodbus_crc16Update(wCRCWord, *nData++);
   return wCRCWord;
 } 
 #endif
+#endif
+#endif
+//#####################################################################################################
+static void mmodbus_rxComplete(void)
+{
+  mmodbus.rxDone = 1;
+  if(mmodbus.active->callback != NULL)
+    sched_post_task(&mmodbus_transactionTask);
+}
 //#####################################################################################################
 void modbus_callback_stack(uart_handle_t* uart, uint8_t data)
 {
-  if(mmodbus.rxIndex <_MMODBUS_RXSIZE - 1)
+  if(mmodbus.rxIndex < _MMODBUS_RXSIZE)
   {
     mmodbus.rxBuf[mmodbus.rxIndex] = data;      
     mmodbus.rxIndex++;
   }
+  else
+    mmodbus.rxOverflow++;
 
-  mmodbus.rxTime = HAL_GetTick();
+  mmodbus.wakeups++;
+  mmodbus_capture(MODBUS_CAPTURE_RX_BYTE, data);
+  mmodbus.rxTime = timer_get_counter_value();
+  if((mmodbus.active != NULL) && (mmodbus.rxDone == 0))
+  {
+    // a response shorter than expected ends with the bus going quiet
+    if(mmodbus.rxIndex == 1)
+      timer_post_task_delay(&mmodbus_silenceTask, mmodbus.silenceTicks);
+    // running CRC over the whole frame including its CRC bytes, a valid frame ends at 0
+    mmodbus.rxCrc = mmodbus_crc16Update(mmodbus.rxCrc, data);
+    // an exception ends after 5 bytes, do not wait for the timeout
+    if((mmodbus.rxIndex == 2) && (data == mmodbus_exceptionFunction(mmodbus.active->txBuf[1])))
+      mmodbus.rxExpected = mmodbus_exceptionSize;
+    if(mmodbus.rxIndex >= mmodbus.rxExpected)
+    {
+      // noise shifted the response, keep receiving until the bus goes quiet and look for it then
+      if(mmodbus.rxCrc == 0)
+        mmodbus_rxComplete();
+      else
+        mmodbus.rxExpected = _MMODBUS_RXSIZE;
+    }
+  }
+  else if(mmodbus.listening == 1)
+  {
+    // a request of a local master, its end is only known once the bus goes quiet
+    if(mmodbus.rxIndex == 1)
+      timer_post_task_delay(&mmodbus_silenceTask, mmodbus.silenceTicks);
+    mmodbus.rxCrc = mmodbus_crc16Update(mmodbus.rxCrc, data);
+  }
 }
 //#####################################################################################################
-void  mmodbus_callback_txDMA(void)
+void  mmodbus_callback_DMA(void)
 {
-  #if _MMODBUS_TXDMA == 1
-  #if _MMODBUS_DMASTREAM == LL_DMA_STREAM_0
-  if(LL_DMA_IsActiveFlag_TC0(_MMODBUS_DMA))
-  {
-    LL_DMA_ClearFlag_TC0(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_1
-  if(LL_DMA_IsActiveFlag_TC1(_MMODBUS_DMA))
-  {
-    LL_DMA_ClearFlag_TC1(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_2
-  if(LL_DMA_IsActiveFlag_TC2(_MMODBUS_DMA))
-  {
-    LL_DMA_ClearFlag_TC2(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_3
-  if(LL_DMA_IsActiveFlag_TC3(_MMODBUS_DMA))
+  mmodbus.wakeups++;
+  #if (_MMODBUS_TXDMA == 1)
+  if(_MMODBUS_DMA->ISR & mmodbus_dmaFlag(DMA_ISR_TCIF1 | DMA_ISR_TEIF1, _MMODBUS_DMA_TXCHANNEL))
   {
-    LL_DMA_ClearFlag_TC3(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_2
-  if(LL_DMA_IsActiveFlag_TC4(_MMODBUS_DMA))
+    // the last byte is in the USART now, the frame is on its way
+    _MMODBUS_DMA->IFCR = mmodbus_dmaFlag(DMA_IFCR_CGIF1, _MMODBUS_DMA_TXCHANNEL);
+    LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL);
+    mmodbus.txDmaDone = 1;
+    mmodbus.txBusy = 0;
+  }
+  #endif
+  #if (_MMODBUS_RXDMA == 1)
+  if(_MMODBUS_DMA->ISR & mmodbus_dmaFlag(DMA_ISR_TCIF1, _MMODBUS_DMA_RXCHANNEL))
   {
-    LL_DMA_ClearFlag_TC4(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_2
-  if(LL_DMA_IsActiveFlag_TC5(_MMODBUS_DMA))
+    // the armed part of the response got transferred without waking up the core for every byte
+    _MMODBUS_DMA->IFCR = mmodbus_dmaFlag(DMA_IFCR_CGIF1, _MMODBUS_DMA_RXCHANNEL);
+    LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+    mmodbus.rxTime = timer_get_counter_value();
+    if((mmodbus.active != NULL) && (mmodbus.rxDone == 0))
+    {
+      mmodbus.rxIndex = mmodbus.rxDmaEnd;
+      // the first 5 bytes tell whether this is an exception or the rest of the response follows
+      if((mmodbus.rxIndex == mmodbus_exceptionSize) && (mmodbus.rxBuf[1] == mmodbus_exceptionFunction(mmodbus.active->txBuf[1])))
+        mmodbus.rxExpected = mmodbus_exceptionSize;
+      if(mmodbus.rxIndex < mmodbus.rxExpected)
+      {
+        mmodbus_armRxDMA(mmodbus.rxIndex, mmodbus.rxExpected - mmodbus.rxIndex);
+        // a response shorter than expected ends with the bus going quiet
+        timer_post_task_delay(&mmodbus_silenceTask, mmodbus.silenceTicks);
+        return;
+      }
+      // no byte interrupts to run the CRC along with, check the frame once in the transfer complete interrupt
+      mmodbus.rxCrc = mmodbus_crc16(mmodbus.rxBuf, mmodbus.rxIndex);
+      if((mmodbus.rxCrc != 0) && (mmodbus.rxIndex < _MMODBUS_RXSIZE))
+      {
+        // noise shifted the response, keep receiving until the bus goes quiet and look for it then
+        mmodbus.rxExpected = _MMODBUS_RXSIZE;
+        mmodbus_armRxDMA(mmodbus.rxIndex, _MMODBUS_RXSIZE - mmodbus.rxIndex);
+        timer_post_task_delay(&mmodbus_silenceTask, mmodbus.silenceTicks);
+        return;
+      }
+      mmodbus_rxComplete();
+    }
+  }
+  #endif
+}
+//#####################################################################################################
+#if (_MMODBUS_TXDMA == 1) || (_MMODBUS_RXDMA == 1)
+void _MMODBUS_DMA_IRQHandler(void)
+{
+  mmodbus_callback_DMA();
+}
+#endif
+//##################################################################################################
+#if (_MMODBUS_RXDMA == 1)
+static void mmodbus_armRxDMA(uint16_t offset, uint16_t length)
+{
+  LL_DMA_ConfigAddresses(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL,
+    LL_USART_DMA_GetRegAddr(_MMODBUS_USART, LL_USART_DMA_REG_DATA_RECEIVE), (uint32_t)&mmodbus.rxBuf[offset],
+    LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+  // the transfer complete interrupt marks the end of the armed part of the response
+  LL_DMA_SetDataLength(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL, length);
+  mmodbus.rxDmaEnd = offset + length;
+  LL_DMA_EnableChannel(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+}
+//##################################################################################################
+static void mmodbus_startRxDMA(void)
+{
+  // the byte interrupt of the listening state would steal the response from the DMA
+  LL_USART_DisableIT_RXNE(_MMODBUS_USART);
+  LL_USART_EnableDMAReq_RX(_MMODBUS_USART);
+  LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+  _MMODBUS_DMA->IFCR = mmodbus_dmaFlag(DMA_IFCR_CGIF1, _MMODBUS_DMA_RXCHANNEL);
+  // drop whatever arrived in between two transactions, an overrun would block the DMA requests
+  if(LL_USART_IsActiveFlag_RXNE(_MMODBUS_USART))
+    mmodbus.rxOverflow++;
+  if(LL_USART_IsActiveFlag_ORE(_MMODBUS_USART))
+    mmodbus.rxOverrun++;
+  LL_USART_ClearFlag_ORE(_MMODBUS_USART);
+  LL_USART_ReceiveData8(_MMODBUS_USART);
+  // every response is at least as long as an exception, receive that first and decide on the rest then
+  mmodbus_armRxDMA(0, mmodbus_exceptionSize);
+}
+//##################################################################################################
+static void mmodbus_stopRxDMA(void)
+{
+  LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+  if((mmodbus.active != NULL) && (mmodbus.rxDone == 0))
+    mmodbus.rxIndex = mmodbus.rxDmaEnd - LL_DMA_GetDataLength(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+}
+#endif
+//##################################################################################################
+// receive requests of a local master while no own transaction is running
+static void mmodbus_listen(void)
+{
+  if(mmodbus.requestHandler == NULL)
+    return;
+  start_atomic();
+  mmodbus.rxIndex = 0;
+  mmodbus.rxCrc = 0xFFFF;
+  mmodbus.listening = 1;
+  #if (_MMODBUS_RXDMA == 1)
+  // the length of a request is not known up front, every byte gets handed over by the uart interrupt
+  LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+  LL_USART_DisableDMAReq_RX(_MMODBUS_USART);
+  LL_USART_EnableIT_RXNE(_MMODBUS_USART);
+  #endif
+  end_atomic();
+}
+//##################################################################################################
+// returns the ticks left until the request of a local master ended, 0 once it got handed over
+static uint32_t mmodbus_checkRequestSilence(void)
+{
+  uint32_t quiet = timer_get_counter_value() - mmodbus.rxTime;
+  if((mmodbus.listening == 0) || (mmodbus.rxIndex == 0))
+    return 0;
+  if(quiet < mmodbus.silenceTicks)
+    return mmodbus.silenceTicks - quiet;
+  sched_post_task(&mmodbus_requestTask);
+  return 0;
+}
+//##################################################################################################
+// returns 0 once the bus stayed quiet for 3.5 characters after the last byte of the response,
+// the ticks left to wait otherwise
+static uint32_t mmodbus_checkSilence(void)
+{
+  uint32_t quiet;
+  start_atomic();
+  if(mmodbus.active == NULL)
   {
-    LL_DMA_ClearFlag_TC5(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_6
-  if(LL_DMA_IsActiveFlag_TC6(_MMODBUS_DMA))
+    quiet = mmodbus_checkRequestSilence();
+    end_atomic();
+    return quiet;
+  }
+  if(mmodbus.rxDone == 1)
   {
-    LL_DMA_ClearFlag_TC6(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
-  #elif _MMODBUS_DMASTREAM == LL_DMA_STREAM_7
-  if(LL_DMA_IsActiveFlag_TC7(_MMODBUS_DMA))
+    end_atomic();
+    return 0;
+  }
+  #if (_MMODBUS_RXDMA == 1)
+  // the DMA counter is the only sign of bytes that arrived after the header
+  uint16_t received = mmodbus.rxDmaEnd - LL_DMA_GetDataLength(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+  if(received != mmodbus.rxIndex)
   {
-    LL_DMA_ClearFlag_TC7(_MMODBUS_DMA);
-    mmodbus.txDmaDone = 1;    
-  }      
+    mmodbus.rxIndex = received;
+    mmodbus.rxTime = timer_get_counter_value();
+  }
   #endif
+  quiet = timer_get_counter_value() - mmodbus.rxTime;
+  if(quiet < mmodbus.silenceTicks)
+  {
+    end_atomic();
+    return mmodbus.silenceTicks - quiet;
+  }
+  // the slave ended its frame before the expected length, let the validation tell what it was
+  #if (_MMODBUS_RXDMA == 1)
+  LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+  mmodbus.rxCrc = mmodbus_crc16(mmodbus.rxBuf, mmodbus.rxIndex);
   #endif
+  mmodbus.rxExpected = mmodbus.rxIndex;
+  mmodbus_rxComplete();
+  end_atomic();
+  return 0;
 }
 //##################################################################################################
-uint16_t mmodbus_receiveRaw(uint8_t expected_length, uint32_t timeout)
+static void mmodbus_silenceTask(void *arg)
 {
-  uint32_t startTime = HAL_GetTick();
-  while(1)
-  {
-    if(HAL_GetTick() - startTime > timeout)
-    {
-      log_print_error_string("timeout occured, length %d", mmodbus.rxIndex);
-      return mmodbus.rxIndex;
-    }
-    if (mmodbus.rxIndex >= expected_length)
-    {
-      return mmodbus.rxIndex; 
-    }
-    mmodbus_delay(1);  
-  }    
-}  
+  mmodbus.wakeups++;
+  uint32_t wait = mmodbus_checkSilence();
+  if(wait > 0)
+    timer_post_task_delay(&mmodbus_silenceTask, wait);
+}
+//##################################################################################################
+// hands a complete request of a local master to the handler, frames with a bad CRC are dropped
+static void mmodbus_requestTask(void *arg)
+{
+  if((mmodbus.listening == 0) || (mmodbus.requestHandler == NULL))
+    return;
+  mmodbus_capture(MODBUS_CAPTURE_REQUEST_END, mmodbus.rxIndex);
+  if((mmodbus.rxIndex >= 4) && (mmodbus.rxIndex <= _MMODBUS_RXSIZE) && (mmodbus.rxCrc == 0))
+    mmodbus.requestHandler(mmodbus.rxBuf, mmodbus.rxIndex - 2);
+  // answered or not, wait for the next request
+  if(mmodbus.active == NULL)
+    mmodbus_listen();
+}
 //##################################################################################################
+// returns false without waiting while a frame is still going out or the previous one did not end yet,
+// the caller retries on a timer
 bool mmodbus_sendRaw(uint8_t *data, uint16_t size, uint32_t timeout)
 {
-  while(mmodbus.txBusy == 1)
-    mmodbus_delay(1);
+  //  the previous frame on the bus needs 3.5 characters of silence before the next one starts
+  if((mmodbus.txBusy == 1) || (mmodbus_getSilenceLeft() > 0))
+    return false;
   mmodbus.txBusy = 1;
-  memset(mmodbus.rxBuf, 0, _MMODBUS_RXSIZE);
+  uint32_t awakeSince = timer_get_counter_value();
+  // only the received length counts, the old contents do not need to be cleared
   mmodbus.rxIndex = 0;
-  uint32_t startTime = HAL_GetTick();
-  // HAL_GPIO_WritePin(_MMODBUS_CTRL_GPIO, _MMODBUS_CTRL_PIN, GPIO_PIN_SET);
-  mmodbus_delay(1);
+  mmodbus.rxCrc = 0xFFFF;
   #if (_MMODBUS_TXDMA == 0)
+  uint32_t startTime = HAL_GetTick();
+  mmodbus_capture(MODBUS_CAPTURE_TX_START, data[0]);
   for (uint16_t i = 0; i < size; i++)
   {
+    // a character takes at most 9 ms at 1200 baud, sleeping a whole ms per byte would stretch the frame
     while (!LL_USART_IsActiveFlag_TXE(_MMODBUS_USART))
     {
-      mmodbus_delay(1);
       if(HAL_GetTick() - startTime > timeout)
       {
-        // HAL_GPIO_WritePin(_MMODBUS_CTRL_GPIO, _MMODBUS_CTRL_PIN, GPIO_PIN_RESET);
+        mmodbus.awakeTicks += timer_get_counter_value() - awakeSince;
         mmodbus.txBusy = 0;
         return false;
       }   
     }
     LL_USART_ClearFlag_TC(_MMODBUS_USART);
     LL_USART_TransmitData8(_MMODBUS_USART, data[i]);
+    mmodbus_capture(MODBUS_CAPTURE_TX_BYTE, data[i]);
   }  
+  #if (_MMODBUS_DE == 0) || (_MMODBUS_CAPTURE == 1)
+  // without a driver enable output, the caller may only turn the transceiver around once the stop bit is out,
+  // a capture waits for it as well to stamp the real end of the frame
   while (!LL_USART_IsActiveFlag_TC(_MMODBUS_USART))
   {
     if(HAL_GetTick() - startTime > timeout)
     {
-      // HAL_GPIO_WritePin(_MMODBUS_CTRL_GPIO, _MMODBUS_CTRL_PIN, GPIO_PIN_RESET);
+      mmodbus.awakeTicks += timer_get_counter_value() - awakeSince;
       mmodbus.txBusy = 0;
       return false;
     }    
   }
+  mmodbus_capture(MODBUS_CAPTURE_TX_END, 0);
+  #endif
   #else
+  // the frame is sent straight from the caller's buffer, the DMA interrupt releases txBusy
   mmodbus.txDmaDone = 0;
-  LL_DMA_ConfigAddresses(_MMODBUS_DMA, _MMODBUS_DMASTREAM,\
-    (uint32_t)data, LL_USART_DMA_GetRegAddr(_MMODBUS_USART),\
-    LL_DMA_GetDataTransferDirection(_MMODBUS_DMA, _MMODBUS_DMASTREAM));
-  LL_DMA_SetDataLength(_MMODBUS_DMA, _MMODBUS_DMASTREAM, size);
-  LL_DMA_EnableStream(_MMODBUS_DMA, _MMODBUS_DMASTREAM);
+  LL_DMA_DisableChannel(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL);
+  LL_DMA_ConfigAddresses(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL,
+    (uint32_t)data, LL_USART_DMA_GetRegAddr(_MMODBUS_USART, LL_USART_DMA_REG_DATA_TRANSMIT),
+    LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+  LL_DMA_SetDataLength(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL, size);
   LL_USART_ClearFlag_TC(_MMODBUS_USART);
-  while(mmodbus.txDmaDone == 0)
-  {
-    mmodbus_delay(1);
-    if(HAL_GetTick() - startTime > timeout)
-    {
-      // HAL_GPIO_WritePin(_MMODBUS_CTRL_GPIO, _MMODBUS_CTRL_PIN, GPIO_PIN_RESET);
-      mmodbus.txBusy = 0;
-      return false;
-    }  
-  }
-  while (!LL_USART_IsActiveFlag_TC(_MMODBUS_USART))
-    mmodbus_delay(1);   
+  LL_DMA_EnableChannel(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL);
+  mmodbus.awakeTicks += timer_get_counter_value() - awakeSince;
+  return true;
   #endif
-  // HAL_GPIO_WritePin(_MMODBUS_CTRL_GPIO, _MMODBUS_CTRL_PIN, GPIO_PIN_RESET);
+  mmodbus.awakeTicks += timer_get_counter_value() - awakeSince;
   mmodbus.txBusy = 0;
   return true;
 }
 //##################################################################################################
 bool mmodbus_init(uint32_t timeout)
 {
-  // HAL_GPIO_WritePin(_MMODBUS_CTRL_GPIO, _MMODBUS_CTRL_PIN, GPIO_PIN_RESET);
-  memset(&mmodbus, 0, sizeof(mmodbus));  
+  memset(&mmodbus, 0, sizeof(mmodbus));
+  mmodbus.rxBuf = (uint8_t*)mmodbus.rxWords + 1;
+  #if( _MMODBUS_RTU == 1)
+  mmodbus_crc16Init();
+  #endif
+  #if (_MMODBUS_TXDMA == 1) || (_MMODBUS_RXDMA == 1)
+  LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+  #endif
   #if (_MMODBUS_TXDMA == 1)
-  LL_DMA_EnableIT_TC(_MMODBUS_DMA, _MMODBUS_DMASTREAM);
+  LL_DMA_SetPeriphRequest(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL, _MMODBUS_DMA_REQUEST);
+  LL_DMA_ConfigTransfer(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL, LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_PRIORITY_HIGH |
+    LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE);
+  LL_DMA_EnableIT_TC(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL);
+  LL_DMA_EnableIT_TE(_MMODBUS_DMA, _MMODBUS_DMA_TXCHANNEL);
   LL_USART_EnableDMAReq_TX(_MMODBUS_USART);
   #endif
+  #if (_MMODBUS_RXDMA == 1)
+  LL_DMA_SetPeriphRequest(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL, _MMODBUS_DMA_REQUEST);
+  LL_DMA_ConfigTransfer(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL, LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_PRIORITY_HIGH |
+    LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE);
+  LL_DMA_EnableIT_TC(_MMODBUS_DMA, _MMODBUS_DMA_RXCHANNEL);
+  LL_USART_EnableDMAReq_RX(_MMODBUS_USART);
+  #endif
+  #if (_MMODBUS_TXDMA == 1) || (_MMODBUS_RXDMA == 1)
+  NVIC_SetPriority(_MMODBUS_DMA_IRQn, 0);
+  NVIC_EnableIRQ(_MMODBUS_DMA_IRQn);
+  #endif
+  #if (_MMODBUS_CAPTURE == 1)
+  modbus_capture_init();
+  #endif
+  #if (_MMODBUS_DE == 1)
+  GPIO_InitTypeDef deConfig = { .Mode = GPIO_MODE_AF_PP, .Pull = GPIO_PULLDOWN, .Speed = GPIO_SPEED_FREQ_HIGH,
+    .Alternate = _MMODBUS_DE_ALTERNATE };
+  hw_gpio_configure_pin_stm(_MMODBUS_DE_PIN, &deConfig);
+  #endif
   // LL_USART_EnableIT_RXNE(_MMODBUS_USART);
   mmodbus.timeout = timeout;
+  mmodbus_setBaudrate(_MMODBUS_BAUDRATE);
+  sched_register_task(&mmodbus_transactionTask);
+  sched_register_task(&mmodbus_silenceTask);
+  sched_register_task(&mmodbus_requestTask);
+  sched_register_task(&mmodbus_wakeupTask);
   return true;
 }
 //##################################################################################################
+// serve a local master in between own transactions, NULL stops listening
+void mmodbus_setRequestHandler(MModBus_RequestHandler_t handler)
+{
+  mmodbus.requestHandler = handler;
+  mmodbus.listening = 0;
+  if(mmodbus.active == NULL)
+    mmodbus_listen();
+}
+//##################################################################################################
+// answer the request handed to the request handler, the data has to stay valid until it got sent.
+// Returns false when the bus is not free, the local master has to repeat its request then
+bool mmodbus_reply(uint8_t *data, uint16_t size)
+{
+  if(mmodbus.active != NULL)
+    return false;
+  return mmodbus_sendRaw(data, size, 100);
+}
+//##################################################################################################
+#if (_MMODBUS_STOPMODE == 1) || (_MMODBUS_DE == 1)
+// settings the uart driver does not know about, they can only change while the uart is disabled
+static void mmodbus_configureUart(uint32_t baudrate)
+{
+  #if (_MMODBUS_STOPMODE == 1)
+  LL_RCC_HSI_Enable();
+  while(LL_RCC_HSI_IsReady() == 0);
+  LL_RCC_SetUSARTClockSource(_MMODBUS_USART_CLKSOURCE);
+  #endif
+  LL_USART_Disable(_MMODBUS_USART);
+  #if (_MMODBUS_STOPMODE == 1)
+  // a uart running from HSI16 keeps receiving while the core is stopped, its baudrate has to follow that clock
+  LL_USART_SetBaudRate(_MMODBUS_USART, HSI_VALUE, LL_USART_GetOverSampling(_MMODBUS_USART), baudrate);
+  //  a received byte wakes the core through the uart interrupt, the clock request of the start bit
+  //  brings HSI16 back up while the core is still stopped
+  LL_USART_EnableInStopMode(_MMODBUS_USART);
+  #endif
+  #if (_MMODBUS_DE == 1)
+  //  the driver follows the frames exactly, the receiver is back on the bus without the core turning it around
+  LL_USART_EnableDEMode(_MMODBUS_USART);
+  LL_USART_SetDESignalPolarity(_MMODBUS_USART, LL_USART_DE_POLARITY_HIGH);
+  LL_USART_SetDEAssertionTime(_MMODBUS_USART, _MMODBUS_DE_ASSERTION);
+  LL_USART_SetDEDeassertionTime(_MMODBUS_USART, _MMODBUS_DE_DEASSERTION);
+  #endif
+  LL_USART_Enable(_MMODBUS_USART);
+}
+#endif
+//##################################################################################################
+void mmodbus_setBaudrate(uint32_t baudrate)
+{
+  // 3.5 characters of 10 bits, fixed at 1750 us above 19200 baud
+  uint32_t silenceUs = (baudrate > 19200) ? 1750 : (35 * 1000000UL) / baudrate;
+  //  a byte gets stamped once its stop bit is in, the next one only after a whole character more,
+  //  a gap just under 3.5 characters must not end the frame before that byte got stamped
+  silenceUs += (10 * 1000000UL) / baudrate;
+  //  the timer only counts ticks of about 1 ms, a difference of n ticks can be little more than n - 1 ticks
+  //  of real silence, round up and add a tick on top
+  mmodbus.silenceTicks = (silenceUs * TIMER_TICKS_PER_SEC + 999999) / 1000000 + 1;
+  mmodbus.charUs = (10 * 1000000UL) / baudrate;
+  //  the uart driver clears the DMA requests when it gets enabled again at another speed,
+  //  the receive request gets enabled again along with every transaction
+  #if (_MMODBUS_TXDMA == 1)
+  LL_USART_EnableDMAReq_TX(_MMODBUS_USART);
+  #endif
+  #if (_MMODBUS_STOPMODE == 1) || (_MMODBUS_DE == 1)
+  mmodbus_configureUart(baudrate);
+  #endif
+}
+//##################################################################################################
 void mmodbus_set16bitOrder(MModBus_16bitOrder_t MModBus_16bitOrder_)
 {
   mmodbus.byteOrder16 = MModBus_16bitOrder_;
@@ -225,6 +688,522 @@ void mmodbus_set32bitOrder(MModBus_32bitOrder_t MModBus_32bitOrder_)
   mmodbus.byteOrder32 = MModBus_32bitOrder_;
 }
 //##################################################################################################
+//  decode kernels, one per byte order: the payload of a read response is aligned in rxWords, so every
+//  register is a single halfword load that REV/REV16 turns into native order
+static void mmodbus_decode16AB(const uint16_t *wire, uint16_t *data, uint16_t length)
+{
+  for(uint16_t i=0 ; i<length ; i++)
+    data[i] = __REV16(wire[i]);
+}
+//##################################################################################################
+static void mmodbus_decode16BA(const uint16_t *wire, uint16_t *data, uint16_t length)
+{
+  for(uint16_t i=0 ; i<length ; i++)
+    data[i] = wire[i];
+}
+//##################################################################################################
+//  a 32 bit value is assembled from two halfwords, which keeps it valid at odd register offsets
+#define mmodbus_wire32(wire, i)   ((uint32_t)(wire)[(i) * 2] | ((uint32_t)(wire)[(i) * 2 + 1] << 16))
+static void mmodbus_decode32ABCD(const uint16_t *wire, uint32_t *data, uint16_t length)
+{
+  uint32_t value;
+  for(uint16_t i=0 ; i<length ; i++)
+  {
+    value = mmodbus_wire32(wire, i);
+    data[i] = __REV16(value);
+  }
+}
+//##################################################################################################
+static void mmodbus_decode32DCBA(const uint16_t *wire, uint32_t *data, uint16_t length)
+{
+  uint32_t value;
+  for(uint16_t i=0 ; i<length ; i++)
+  {
+    value = mmodbus_wire32(wire, i);
+    data[i] = __ROR(value, 16);
+  }
+}
+//##################################################################################################
+static void mmodbus_decode32BADC(const uint16_t *wire, uint32_t *data, uint16_t length)
+{
+  for(uint16_t i=0 ; i<length ; i++)
+    data[i] = mmodbus_wire32(wire, i);
+}
+//##################################################################################################
+static void mmodbus_decode32CDAB(const uint16_t *wire, uint32_t *data, uint16_t length)
+{
+  uint32_t value;
+  for(uint16_t i=0 ; i<length ; i++)
+  {
+    value = mmodbus_wire32(wire, i);
+    data[i] = __REV(value);
+  }
+}
+//##################################################################################################
+static void mmodbus_appendCrc(MModBus_Transaction_t *transaction)
+{
+  uint16_t crc = mmodbus_crc16(transaction->txBuf, transaction->txSize);
+  transaction->txBuf[transaction->txSize++] = (crc & 0x00FF);
+  transaction->txBuf[transaction->txSize++] = (crc & 0xFF00) >> 8;
+}
+//##################################################################################################
+static void mmodbus_prepareHeader(MModBus_Transaction_t *transaction, uint8_t slaveAddress, MModbusCMD_t cmd, uint16_t number, uint16_t value)
+{
+  memset(transaction, 0, sizeof(MModBus_Transaction_t));
+  transaction->txBuf[0] = slaveAddress;
+  transaction->txBuf[1] = cmd;
+  transaction->txBuf[2] = (number & 0xFF00) >> 8;
+  transaction->txBuf[3] = (number & 0x00FF);
+  transaction->txBuf[4] = (value & 0xFF00) >> 8;
+  transaction->txBuf[5] = (value & 0x00FF);
+  transaction->txSize = 6;
+  transaction->timeout = mmodbus.timeout;
+}
+//##################################################################################################
+bool mmodbus_prepareRead(MModBus_Transaction_t *transaction, uint8_t slaveAddress, MModbusCMD_t cmd, uint16_t startnumber, uint16_t length)
+{
+  uint16_t expectedLength;
+  if(cmd > MModbusCMD_ReadInputRegisters)
+    return false;
+  // expected length: payload + 2 X CRC bytes + 1 address + 1 function code + 1 length byte
+  if((cmd == MModbusCMD_ReadCoilStatus) || (cmd == MModbusCMD_ReadDiscreteInputs))
+    expectedLength = ((length + 7) / 8) + 2 + 3;
+  else
+    expectedLength = (length * 2) + 2 + 3;
+  // the byte count field limits a read to 2000 bits or 125 registers
+  if((length == 0) || (expectedLength > 255) || (expectedLength > _MMODBUS_RXSIZE))
+    return false;
+  mmodbus_prepareHeader(transaction, slaveAddress, cmd, startnumber, length);
+  mmodbus_appendCrc(transaction);
+  transaction->expectedLength = expectedLength;
+  return true;
+}
+//##################################################################################################
+bool mmodbus_prepareWriteSingle(MModBus_Transaction_t *transaction, uint8_t slaveAddress, MModbusCMD_t cmd, uint16_t number, uint16_t data)
+{
+  if((cmd != MModbusCMD_WriteSingleCoil) && (cmd != MModbusCMD_WriteSingleRegister))
+    return false;
+  mmodbus_prepareHeader(transaction, slaveAddress, cmd, number, data);
+  mmodbus_appendCrc(transaction);
+  // the slave echoes the request
+  transaction->expectedLength = 8;
+  return true;
+}
+//##################################################################################################
+bool mmodbus_prepareWriteMultipleRegisters(MModBus_Transaction_t *transaction, uint8_t slaveAddress, uint16_t startnumber, uint16_t length, const uint16_t *data)
+{
+  if(7 + length * 2 + 2 > _MMODBUS_TXSIZE)
+    return false;
+  mmodbus_prepareHeader(transaction, slaveAddress, MModbusCMD_WriteMultipleRegisters, startnumber, length);
+  transaction->txBuf[6] = (length * 2);
+  uint8_t tmp1[2],tmp2[2];
+  for(uint16_t i=0 ; i<length ; i++)
+  {
+    switch(mmodbus.byteOrder16)
+    {
+      case MModBus_16bitOrder_AB:
+      memcpy(tmp1, &data[i], 2);
+      tmp2[0] = tmp1[1];
+      tmp2[1] = tmp1[0];
+      memcpy(&transaction->txBuf[7 + i * 2], tmp2, 2);
+      break;
+      default:
+      memcpy(tmp1, &data[i], 2);
+      tmp2[0] = tmp1[0];
+      tmp2[1] = tmp1[1];
+      memcpy(&transaction->txBuf[7 + i * 2], tmp2, 2);
+      break;
+    }
+  }
+  transaction->txSize = 7 + length * 2;
+  mmodbus_appendCrc(transaction);
+  // the slave answers with the address, function code, start and quantity of the request
+  transaction->expectedLength = 8;
+  return true;
+}
+//##################################################################################################
+// looks for the response inside a frame with noise before or after it and moves it to the start of rxBuf,
+// where the register payload is aligned again
+static bool mmodbus_resync(const MModBus_Transaction_t *transaction)
+{
+  uint8_t *frame;
+  uint16_t length;
+  for(uint16_t offset = 0; offset + mmodbus_exceptionSize <= mmodbus.rxIndex; offset++)
+  {
+    frame = &mmodbus.rxBuf[offset];
+    if(frame[0] != transaction->txBuf[0])
+      continue;
+    if(frame[1] == mmodbus_exceptionFunction(transaction->txBuf[1]))
+      length = mmodbus_exceptionSize;
+    else if(frame[1] != transaction->txBuf[1])
+      continue;
+    else if(transaction->txBuf[1] <= MModbusCMD_ReadInputRegisters)
+      length = frame[2] + 5;
+    else
+      length = 8;
+    if((offset + length > mmodbus.rxIndex) || (mmodbus_crc16(frame, length) != 0))
+      continue;
+    memmove(mmodbus.rxBuf, frame, length);
+    mmodbus.rxDiscarded += mmodbus.rxIndex - length;
+    mmodbus.rxRecovered++;
+    mmodbus.rxIndex = length;
+    mmodbus.rxCrc = 0;
+    return true;
+  }
+  return false;
+}
+//##################################################################################################
+static MModBus_Status_t mmodbus_validateResponse(MModBus_Transaction_t *transaction)
+{
+  if(mmodbus.txError == 1)
+    return MModBus_Status_SendError;
+  if(mmodbus.rxDone == 0)
+    return MModBus_Status_Timeout;
+  if((mmodbus.rxCrc != 0) || (mmodbus.rxBuf[0] != transaction->txBuf[0]))
+    mmodbus_resync(transaction);
+  // the CRC got checked byte by byte while the frame came in
+  if(mmodbus.rxCrc != 0)
+    return MModBus_Status_CrcError;
+  if(mmodbus.rxBuf[0] != transaction->txBuf[0])
+    return MModBus_Status_WrongSlave;
+  if(mmodbus.rxBuf[1] == mmodbus_exceptionFunction(transaction->txBuf[1]))
+  {
+    transaction->exception = mmodbus.rxBuf[2];
+    return MModBus_Status_Exception;
+  }
+  if(mmodbus.rxBuf[1] != transaction->txBuf[1])
+    return MModBus_Status_WrongFunction;
+  if(transaction->txBuf[1] <= MModbusCMD_ReadInputRegisters)
+  {
+    // address, function code, byte count, payload, CRC
+    if(mmodbus.rxBuf[2] != transaction->expectedLength - 5)
+      return MModBus_Status_InvalidResponse;
+    transaction->data = &mmodbus.rxBuf[3];
+    transaction->dataLength = mmodbus.rxBuf[2];
+  }
+  else
+  {
+    // writes are answered with the address and quantity of the request
+    if(memcmp(&mmodbus.rxBuf[2], &transaction->txBuf[2], 4) != 0)
+      return MModBus_Status_InvalidResponse;
+    transaction->data = &mmodbus.rxBuf[2];
+    transaction->dataLength = 4;
+  }
+  return MModBus_Status_Ok;
+}
+//##################################################################################################
+static void mmodbus_countLatency(uint8_t function, uint32_t latency)
+{
+  uint8_t bucket = 0;
+  for(uint8_t i = 0; i < _MMODBUS_STATS_FUNCTIONS; i++)
+  {
+    MModBus_LatencyHistogram_t *histogram = &mmodbus.stats.latency[i];
+    if(histogram->function == 0)
+      histogram->function = function;
+    if(histogram->function != function)
+      continue;
+    while((bucket < _MMODBUS_LATENCY_BUCKETS - 1) && (latency >= mmodbus_latencyLimits[bucket]))
+      bucket++;
+    mmodbus_countUp(histogram->buckets[bucket]);
+    return;
+  }
+}
+//##################################################################################################
+static void mmodbus_countStatus(const MModBus_Transaction_t *transaction)
+{
+  mmodbus_countUp(mmodbus.stats.requests);
+  switch(transaction->status)
+  {
+    case MModBus_Status_Ok:
+      mmodbus_countUp(mmodbus.stats.successes);
+      break;
+    case MModBus_Status_Timeout:
+      mmodbus_countUp(mmodbus.stats.timeouts);
+      break;
+    case MModBus_Status_CrcError:
+      mmodbus_countUp(mmodbus.stats.crcErrors);
+      break;
+    case MModBus_Status_Exception:
+      mmodbus_countUp(mmodbus.stats.exceptions);
+      break;
+    default:
+      break;
+  }
+  // only answers have a latency, the last byte of it marks the end
+  if((transaction->status == MModBus_Status_Ok) || (transaction->status == MModBus_Status_Exception))
+    mmodbus_countLatency(transaction->txBuf[1], mmodbus_ticksToMs(mmodbus.rxTime - mmodbus.txTick));
+}
+//##################################################################################################
+static void mmodbus_finishTransaction(MModBus_Transaction_t *transaction)
+{
+  #if (_MMODBUS_RXDMA == 1)
+  mmodbus_stopRxDMA();
+  #endif
+  // a byte got lost because the previous one was not read out in time
+  if(LL_USART_IsActiveFlag_ORE(_MMODBUS_USART))
+  {
+    mmodbus.rxOverrun++;
+    LL_USART_ClearFlag_ORE(_MMODBUS_USART);
+  }
+  transaction->status = mmodbus_validateResponse(transaction);
+  transaction->success = (transaction->status == MModBus_Status_Ok);
+  mmodbus_capture(MODBUS_CAPTURE_RESPONSE_END, transaction->status);
+  mmodbus_countStatus(transaction);
+  if(transaction->status == MModBus_Status_Timeout)
+    log_print_error_string("timeout occured, length %d", mmodbus.rxIndex);
+  else if(transaction->status == MModBus_Status_Exception)
+    log_print_error_string("slave %d answered function %d with exception %d", transaction->txBuf[0], transaction->txBuf[1], transaction->exception);
+  else if(transaction->success == false)
+    log_print_error_string("invalid response, status %d length %d", transaction->status, mmodbus.rxIndex);
+  transaction->state = MModBus_TransactionState_Done;
+  mmodbus.active = NULL;
+}
+//##################################################################################################
+// runs when the RX callback received the expected amount of bytes or when the timeout expired
+static void mmodbus_transactionTask(void *arg)
+{
+  MModBus_Transaction_t *transaction = mmodbus.active;
+  if((transaction == NULL) || (transaction->callback == NULL))
+    return;
+  mmodbus.wakeups++;
+  timer_cancel_task(&mmodbus_transactionTask);
+  timer_cancel_task(&mmodbus_silenceTask);
+  mmodbus_finishTransaction(transaction);
+  transaction->callback(transaction);
+  // the callback may have submitted the next transaction already
+  if(mmodbus.active == NULL)
+    mmodbus_listen();
+}
+//##################################################################################################
+bool mmodbus_isBusy(void)
+{
+  return (mmodbus.active != NULL);
+}
+//##################################################################################################
+uint32_t mmodbus_getRxOverflow(void)
+{
+  return mmodbus.rxOverflow;
+}
+//##################################################################################################
+uint32_t mmodbus_getRxOverrun(void)
+{
+  return mmodbus.rxOverrun;
+}
+//##################################################################################################
+uint32_t mmodbus_getRxRecovered(void)
+{
+  return mmodbus.rxRecovered;
+}
+//##################################################################################################
+uint32_t mmodbus_getRxDiscarded(void)
+{
+  return mmodbus.rxDiscarded;
+}
+//##################################################################################################
+void mmodbus_getStatistics(MModBus_Statistics_t *stats)
+{
+  *stats = mmodbus.stats;
+  stats->overruns = mmodbus_saturate(mmodbus.rxOverrun);
+  stats->recovered = mmodbus_saturate(mmodbus.rxRecovered);
+  stats->discarded = mmodbus_saturate(mmodbus.rxDiscarded);
+}
+//##################################################################################################
+void mmodbus_resetStatistics(void)
+{
+  memset(&mmodbus.stats, 0, sizeof(mmodbus.stats));
+  mmodbus.rxOverrun = 0;
+  mmodbus.rxRecovered = 0;
+  mmodbus.rxDiscarded = 0;
+  mmodbus.awakeTicks = 0;
+  mmodbus.wakeups = 0;
+}
+//##################################################################################################
+// timer ticks the core spent sending, the time it waits for an answer is spent in the scheduler's sleep
+uint32_t mmodbus_getAwakeTicks(void)
+{
+  return mmodbus.awakeTicks;
+}
+//##################################################################################################
+// received bytes, DMA interrupts and tasks that woke the core up for the bus
+uint32_t mmodbus_getWakeups(void)
+{
+  return mmodbus.wakeups;
+}
+//##################################################################################################
+// ticks until the frame delimiting silence after the last received byte passed, a new frame may start then
+uint32_t mmodbus_getSilenceLeft(void)
+{
+  uint32_t quiet = timer_get_counter_value() - mmodbus.rxTime;
+  return (quiet < mmodbus.silenceTicks) ? mmodbus.silenceTicks - quiet : 0;
+}
+//##################################################################################################
+// timer ticks at which the last transaction went on the bus, time it spent waiting in a queue before does not count
+uint32_t mmodbus_getTxTick(void)
+{
+  return mmodbus.txTick;
+}
+//##################################################################################################
+// the slave will give the same answer to the same request, repeating it is of no use
+bool mmodbus_isPermanentError(const MModBus_Transaction_t *transaction)
+{
+  if(transaction->status != MModBus_Status_Exception)
+    return false;
+  return (transaction->exception == MModBus_Exception_IllegalFunction) ||
+    (transaction->exception == MModBus_Exception_IllegalDataAddress) ||
+    (transaction->exception == MModBus_Exception_IllegalDataValue);
+}
+//##################################################################################################
+//  the timeout counts from the start of the request, at a low rate a long response alone outlasts it,
+//  wait for both frames on top of it
+static uint32_t mmodbus_timeoutTicks(MModBus_Transaction_t *transaction)
+{
+  uint32_t wireUs = (transaction->txSize + transaction->expectedLength) * mmodbus.charUs;
+  return mmodbus_msToTicks(transaction->timeout) + (wireUs * TIMER_TICKS_PER_SEC + 999999) / 1000000;
+}
+//##################################################################################################
+bool mmodbus_submit(MModBus_Transaction_t *transaction)
+{
+  if(mmodbus.active != NULL)
+    return false;
+  // a local master is talking or waiting for its answer, do not collide with it
+  if((mmodbus.listening == 1) && ((mmodbus.rxIndex > 0) || (mmodbus.txBusy == 1)))
+    return false;
+  // a reply or the previous frame is still on the bus, the request could not be sent now
+  if((mmodbus.txBusy == 1) || (mmodbus_getSilenceLeft() > 0))
+    return false;
+  mmodbus.listening = 0;
+  transaction->state = MModBus_TransactionState_Busy;
+  transaction->success = false;
+  transaction->status = MModBus_Status_Timeout;
+  transaction->exception = MModBus_Exception_None;
+  transaction->data = NULL;
+  transaction->dataLength = 0;
+  mmodbus.rxDone = 0;
+  mmodbus.txError = 0;
+  mmodbus.rxExpected = transaction->expectedLength;
+  mmodbus.active = transaction;
+  #if (_MMODBUS_RXDMA == 1)
+  // arm the receiver before the request leaves, the first byte of the response can follow quickly
+  mmodbus_startRxDMA();
+  #endif
+  mmodbus.txTick = timer_get_counter_value();
+  if(mmodbus_sendRaw(transaction->txBuf, transaction->txSize, 100) == false)
+  {
+    // nothing will be received, let the transaction fail right away
+    mmodbus.txError = 1;
+    mmodbus.rxDone = 1;
+    if(transaction->callback != NULL)
+      sched_post_task(&mmodbus_transactionTask);
+    return true;
+  }
+  mmodbus.txTime = HAL_GetTick();
+  if(transaction->callback != NULL)
+    timer_post_task_delay(&mmodbus_transactionTask, mmodbus_timeoutTicks(transaction));
+  return true;
+}
+//##################################################################################################
+//  the scheduler does not run while a blocking wrapper waits, the timer interrupt of this task wakes the core up
+//  when nothing else does
+static void mmodbus_wakeupTask(void *arg)
+{
+}
+//##################################################################################################
+bool mmodbus_execute(MModBus_Transaction_t *transaction)
+{
+  uint32_t silence;
+  uint32_t timeout = mmodbus_timeoutTicks(transaction);
+  transaction->callback = NULL;
+  //  SysTick does not have to run in low power, sleep on the timer until the previous frame ended
+  while((silence = mmodbus_getSilenceLeft()) > 0)
+  {
+    timer_post_task_delay(&mmodbus_wakeupTask, silence);
+    __WFI();
+  }
+  if(mmodbus_submit(transaction) == false)
+    return false;
+  timer_post_task_delay(&mmodbus_wakeupTask, timeout + 1);
+  while((mmodbus.rxDone == 0) && (timer_get_counter_value() - mmodbus.txTick <= timeout))
+  {
+    // sleep until the next byte or timer, the core does not need to spin through the turnaround
+    __WFI();
+    // the scheduler does not run the silence task while we wait here
+    if(mmodbus.rxIndex > 0)
+      mmodbus_checkSilence();
+  }
+  timer_cancel_task(&mmodbus_wakeupTask);
+  timer_cancel_task(&mmodbus_silenceTask);
+  mmodbus_finishTransaction(transaction);
+  mmodbus_listen();
+  return transaction->success;
+}
+//##################################################################################################
+void mmodbus_getRegisters8i(const MModBus_Transaction_t *transaction, uint8_t *data)
+{
+  for(uint16_t i=0 ; i<transaction->dataLength ; i+=2)
+  {
+    data[i] = transaction->data[i+1];
+    data[i+1] = transaction->data[i];
+  }
+}
+//##################################################################################################
+bool mmodbus_getRegisterRange16i(const MModBus_Transaction_t *transaction, uint16_t first, uint16_t length, uint16_t *data)
+{
+  const uint16_t *wire = (const uint16_t*)transaction->data + first;
+  if((first + length) * 2 > transaction->dataLength)
+    return false;
+  if(mmodbus.byteOrder16 == MModBus_16bitOrder_AB)
+    mmodbus_decode16AB(wire, data, length);
+  else
+    mmodbus_decode16BA(wire, data, length);
+  return true;
+}
+//##################################################################################################
+bool mmodbus_getRegisterRange32i(const MModBus_Transaction_t *transaction, uint16_t first, uint16_t length, uint32_t *data)
+{
+  const uint16_t *wire = (const uint16_t*)transaction->data + first;
+  if((first + length * 2) * 2 > transaction->dataLength)
+    return false;
+  switch(mmodbus.byteOrder32)
+  {
+    case MModBus_32bitOrder_DCBA:
+      mmodbus_decode32DCBA(wire, data, length);
+    break;
+    case MModBus_32bitOrder_BADC:
+      mmodbus_decode32BADC(wire, data, length);
+    break;
+    case MModBus_32bitOrder_CDAB:
+      mmodbus_decode32CDAB(wire, data, length);
+    break;
+    default:
+      mmodbus_decode32ABCD(wire, data, length);
+    break;
+  }
+  return true;
+}
+//##################################################################################################
+void mmodbus_getRegisters16i(const MModBus_Transaction_t *transaction, uint16_t *data)
+{
+  mmodbus_getRegisterRange16i(transaction, 0, transaction->dataLength / 2, data);
+}
+//##################################################################################################
+void mmodbus_getRegisters32i(const MModBus_Transaction_t *transaction, uint32_t *data)
+{
+  mmodbus_getRegisterRange32i(transaction, 0, transaction->dataLength / 4, data);
+}
+//##################################################################################################
+void mmodbus_getRegisters32f(const MModBus_Transaction_t *transaction, float *data)
+{
+  // the registers hold the IEEE 754 bit pattern, it only needs the same reordering as an integer
+  mmodbus_getRegisters32i(transaction, (uint32_t*)data);
+}
+//##################################################################################################
+static bool mmodbus_readRegisters(MModBus_Transaction_t *transaction, uint8_t slaveAddress, MModbusCMD_t cmd, uint16_t startnumber, uint16_t length)
+{
+  if(mmodbus_prepareRead(transaction, slaveAddress, cmd, startnumber, length) == false)
+    return false;
+  return mmodbus_execute(transaction);
+}
+//##################################################################################################
 bool mmodbus_readCoil(uint8_t slaveAddress, uint16_t number, uint8_t *data)
 {
   return mmodbus_readCoils(slaveAddress, number, 1, data);
@@ -233,69 +1212,35 @@ bool mmodbus_readCoil(uint8_t slaveAddress, uint16_t number, uint8_t *data)
 bool mmodbus_readCoils(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint8_t *data)
 {
   #if( _MMODBUS_RTU == 1)
-  uint8_t txData[8];
-  txData[0] = slaveAddress;
-  txData[1] = MModbusCMD_ReadCoilStatus;
-  txData[2] = (startnumber & 0xFF00) >> 8;
-  txData[3] = (startnumber & 0x00FF);
-  txData[4] = (length & 0xFF00) >> 8;
-  txData[5] = (length & 0x00FF);
-  static uint16_t  crc;
-  crc = mmodbus_crc16(txData, 6);
-  txData[6] = (crc & 0x00FF);
-  txData[7] = (crc & 0xFF00) >> 8;
-  mmodbus_sendRaw(txData, 8, 100);
-  uint16_t recLen = mmodbus_receiveRaw((length*2) + 2 + 3, mmodbus.timeout);
-  if(recLen == 0)
-    return false;
-  if(mmodbus.rxBuf[0] != slaveAddress)
-    return false;
-  if(mmodbus.rxBuf[1] != MModbusCMD_ReadCoilStatus)
-    return false;
-  crc = mmodbus_crc16(mmodbus.rxBuf, mmodbus.rxBuf[2] + 3);
-  if(((crc & 0x00FF) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 3]) || (((crc & 0xFF00) >> 8) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 4]))
-    return false; 
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareRead(&transaction, slaveAddress, MModbusCMD_ReadCoilStatus, startnumber, length) == false)
+    return false;
+  if(mmodbus_execute(&transaction) == false)
+    return false;
   if(data != NULL)
-    memcpy(data, &mmodbus.rxBuf[3], mmodbus.rxBuf[2]);   
+    memcpy(data, transaction.data, transaction.dataLength);
   return true;
   #endif
   #if( _MMODBUS_ASCII == 1)
-  
+
   #endif
 }
 //##################################################################################################
 bool mmodbus_readDiscreteInput(uint8_t slaveAddress, uint16_t number, uint8_t *data)
 {
-  return mmodbus_readDiscreteInputs(slaveAddress, number, 1, data); 
+  return mmodbus_readDiscreteInputs(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readDiscreteInputs(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint8_t *data)
 {
   #if( _MMODBUS_RTU == 1)
-  uint8_t txData[8];
-  txData[0] = slaveAddress;
-  txData[1] = MModbusCMD_ReadDiscreteInputs;
-  txData[2] = (startnumber & 0xFF00) >> 8;
-  txData[3] = (startnumber & 0x00FF);
-  txData[4] = (length & 0xFF00) >> 8;
-  txData[5] = (length & 0x00FF);
-  static uint16_t  crc;
-  crc = mmodbus_crc16(txData, 6);
-  txData[6] = (crc & 0x00FF);
-  txData[7] = (crc & 0xFF00) >> 8;
-  mmodbus_sendRaw(txData, 8, 100);
-  uint16_t recLen = mmodbus_receiveRaw((length*2) + 2 + 3, mmodbus.timeout);
-  if(recLen == 0)
-    return false;
-  if(mmodbus.rxBuf[0] != slaveAddress)
-    return false;
-  if(mmodbus.rxBuf[1] != MModbusCMD_ReadDiscreteInputs)
-    return false;
-  crc = mmodbus_crc16(mmodbus.rxBuf, mmodbus.rxBuf[2] + 3);
-  if(((crc & 0x00FF) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 3]) || (((crc & 0xFF00) >> 8) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 4]))
-    return false; 
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareRead(&transaction, slaveAddress, MModbusCMD_ReadDiscreteInputs, startnumber, length) == false)
+    return false;
+  if(mmodbus_execute(&transaction) == false)
+    return false;
   if(data != NULL)
-    memcpy(data, &mmodbus.rxBuf[3], mmodbus.rxBuf[2]);   
+    memcpy(data, transaction.data, transaction.dataLength);
   return true;
   #endif
 }
@@ -303,429 +1248,179 @@ bool mmodbus_readDiscreteInputs(uint8_t slaveAddress, uint16_t startnumber, uint
 bool mmodbus_readInputRegisters8i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint8_t *data)
 {
   #if( _MMODBUS_RTU == 1)
-  uint8_t txData[8];
-  txData[0] = slaveAddress;
-  txData[1] = MModbusCMD_ReadInputRegisters;
-  txData[2] = (startnumber & 0xFF00) >> 8;
-  txData[3] = (startnumber & 0x00FF);
-  txData[4] = (length & 0xFF00) >> 8;
-  txData[5] = (length & 0x00FF);
-  static uint16_t  crc;
-  crc = mmodbus_crc16(txData, 6);
-  txData[6] = (crc & 0x00FF);
-  txData[7] = (crc & 0xFF00) >> 8;
-  mmodbus_sendRaw(txData, 8, 100);
-  uint16_t recLen = mmodbus_receiveRaw((length*2) + 2 + 3, mmodbus.timeout);
-  if(recLen == 0)
-    return false;
-  if(mmodbus.rxBuf[0] != slaveAddress)
-    return false;
-  if(mmodbus.rxBuf[1] != MModbusCMD_ReadInputRegisters)
-    return false;
-  crc = mmodbus_crc16(mmodbus.rxBuf, mmodbus.rxBuf[2] + 3);
-  if(((crc & 0x00FF) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 3]) || (((crc & 0xFF00) >> 8) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 4]))
-    return false;  
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareRead(&transaction, slaveAddress, MModbusCMD_ReadInputRegisters, startnumber, length) == false)
+    return false;
+  if(mmodbus_execute(&transaction) == false)
+    return false;
   if(data != NULL)
-    memcpy(data, &mmodbus.rxBuf[3], mmodbus.rxBuf[2]);   
+    memcpy(data, transaction.data, transaction.dataLength);
   return true;
   #endif
 }
 //##################################################################################################
 bool mmodbus_readInputRegister32f(uint8_t slaveAddress, uint16_t number, float *data)
 {
-  return mmodbus_readInputRegisters32f(slaveAddress, number, 1, data); 
+  return mmodbus_readInputRegisters32f(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readInputRegisters32f(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, float *data)
 {
-  bool ret = mmodbus_readInputRegisters8i(slaveAddress, startnumber, length * 2, (uint8_t*)data);
-  if(ret == true)
-  {
-    for(uint16_t i=0 ; i<length ; i++)
-    {  
-      uint8_t tmp1[4],tmp2[4];
-      switch(mmodbus.byteOrder32)
-      {
-        case MModBus_32bitOrder_DCBA:
-          memcpy(tmp1, &data[i], 4);       
-          tmp2[0] = tmp1[3];
-          tmp2[1] = tmp1[2];
-          tmp2[2] = tmp1[1];
-          tmp2[3] = tmp1[0];
-          memcpy(&data[i], tmp2, 4);    
-        break;
-        case MModBus_32bitOrder_BADC:
-          memcpy(tmp1, &data[i], 4);       
-          tmp2[0] = tmp1[1];
-          tmp2[1] = tmp1[0];
-          tmp2[2] = tmp1[3];
-          tmp2[3] = tmp1[2];
-          memcpy(&data[i], tmp2, 4);           
-        break;
-        case MModBus_32bitOrder_CDAB:
-          memcpy(tmp1, &data[i], 4);       
-          tmp2[0] = tmp1[2];
-          tmp2[1] = tmp1[3];
-          tmp2[2] = tmp1[0];
-          tmp2[3] = tmp1[1];
-          memcpy(&data[i], tmp2, 4);    
-        break;
-        default:
-          
-        break;
-      }        
-    }
-    return true;
-  }
-  else
+  #if( _MMODBUS_RTU == 1)
+  MModBus_Transaction_t transaction;
+  if(mmodbus_readRegisters(&transaction, slaveAddress, MModbusCMD_ReadInputRegisters, startnumber, length * 2) == false)
     return false;
+  if(data != NULL)
+    mmodbus_getRegisters32f(&transaction, data);
+  return true;
+  #endif
 }
 //##################################################################################################
 bool mmodbus_readInputRegister32i(uint8_t slaveAddress, uint16_t number, uint32_t *data)
 {
-  return mmodbus_readInputRegisters32i(slaveAddress, number, 1, data); 
+  return mmodbus_readInputRegisters32i(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readInputRegisters32i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint32_t *data)
 {
-  return mmodbus_readInputRegisters32f(slaveAddress, startnumber, length, (float*)data);
+  #if( _MMODBUS_RTU == 1)
+  MModBus_Transaction_t transaction;
+  if(mmodbus_readRegisters(&transaction, slaveAddress, MModbusCMD_ReadInputRegisters, startnumber, length * 2) == false)
+    return false;
+  if(data != NULL)
+    mmodbus_getRegisters32i(&transaction, data);
+  return true;
+  #endif
 }
 //##################################################################################################
 bool mmodbus_readInputRegister16i(uint8_t slaveAddress, uint16_t number, uint16_t *data)
 {
-  return mmodbus_readInputRegisters16i(slaveAddress, number, 1, data); 
+  return mmodbus_readInputRegisters16i(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readInputRegisters16i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint16_t *data)
 {
-  bool ret = mmodbus_readInputRegisters8i(slaveAddress, startnumber, length * 1, (uint8_t*)data);
-  if(ret == true)
-  {
-    uint8_t tmp1[2],tmp2[2];
-    for(uint16_t i=0 ; i<length ; i++)
-    {   
-      switch(mmodbus.byteOrder16)
-      {
-        case MModBus_16bitOrder_AB:
-          memcpy(tmp1, &data[i], 2);       
-          tmp2[0] = tmp1[0];
-          tmp2[1] = tmp1[1];
-          memcpy(&data[i], tmp2, 2);    
-        break;
-        default:
-          memcpy(tmp1, &data[i], 2);       
-          tmp2[0] = tmp1[1];
-          tmp2[1] = tmp1[0];
-          memcpy(&data[i], tmp2, 2);    
-        break;
-      }
-    }
-    return true;
-  }
-  else
+  #if( _MMODBUS_RTU == 1)
+  MModBus_Transaction_t transaction;
+  if(mmodbus_readRegisters(&transaction, slaveAddress, MModbusCMD_ReadInputRegisters, startnumber, length * 1) == false)
     return false;
+  if(data != NULL)
+    mmodbus_getRegisters16i(&transaction, data);
+  return true;
+  #endif
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegisters8i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint8_t *data)
 {
   #if( _MMODBUS_RTU == 1)
-  uint8_t txData[8];
-  txData[0] = slaveAddress;
-  txData[1] = MModbusCMD_ReadHoldingRegisters;
-  txData[2] = (startnumber & 0xFF00) >> 8;
-  txData[3] = (startnumber & 0x00FF);
-  txData[4] = (length & 0xFF00) >> 8;
-  txData[5] = (length & 0x00FF);
-  static uint16_t  crc;
-  crc = mmodbus_crc16(txData, 6);
-  txData[6] = (crc & 0x00FF);
-  txData[7] = (crc & 0xFF00) >> 8;
-  mmodbus_sendRaw(txData, 8, 100);
-  // expected length: # registers + 2 X CRC bytes + 1 address + 1 function code + 1 length byte
-  uint16_t recLen = mmodbus_receiveRaw((length*2) + 2 + 3, mmodbus.timeout);
-  if(recLen == 0)
-    return false;
-  if(mmodbus.rxBuf[0] != slaveAddress)
-    return false;
-  if(mmodbus.rxBuf[1] != MModbusCMD_ReadHoldingRegisters)
-    return false;
-  crc = mmodbus_crc16(mmodbus.rxBuf, mmodbus.rxBuf[2] + 3);
-  if(((crc & 0x00FF) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 3]) || (((crc & 0xFF00) >> 8) != mmodbus.rxBuf[mmodbus.rxBuf[2] + 4]))
-    return false; 
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareRead(&transaction, slaveAddress, MModbusCMD_ReadHoldingRegisters, startnumber, length) == false)
+    return false;
+  if(mmodbus_execute(&transaction) == false)
+    return false;
   if(data != NULL)
-  {
-    for(uint8_t i=0 ; i<mmodbus.rxBuf[2] ; i+=2)
-    {    
-      uint8_t H = mmodbus.rxBuf[i+3];
-      mmodbus.rxBuf[i+3] = mmodbus.rxBuf[i+3+1];
-      mmodbus.rxBuf[i+3+1] = H;      
-    }
-    memcpy(data, &mmodbus.rxBuf[3], mmodbus.rxBuf[2]);   
-  }
+    mmodbus_getRegisters8i(&transaction, data);
   return true;
   #endif
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegister32f(uint8_t slaveAddress, uint16_t number, float *data)
 {
-  return mmodbus_readHoldingRegisters32f(slaveAddress, number, 1, data); 
+  return mmodbus_readHoldingRegisters32f(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegisters32f(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, float *data)
 {
-  bool ret = mmodbus_readHoldingRegisters8i(slaveAddress, startnumber, length * 2, (uint8_t*)data);
-  if(ret == true)
-  {
-    for(uint16_t i=0 ; i<length ; i++)
-    {  
-      uint8_t tmp1[4],tmp2[4];
-      switch(mmodbus.byteOrder32)
-      {
-        case MModBus_32bitOrder_DCBA:
-          memcpy(tmp1, &data[i], 4);       
-          tmp2[0] = tmp1[3];
-          tmp2[1] = tmp1[2];
-          tmp2[2] = tmp1[1];
-          tmp2[3] = tmp1[0];
-          memcpy(&data[i], tmp2, 4);    
-        break;
-        case MModBus_32bitOrder_BADC:
-          memcpy(tmp1, &data[i], 4);       
-          tmp2[0] = tmp1[1];
-          tmp2[1] = tmp1[0];
-          tmp2[2] = tmp1[3];
-          tmp2[3] = tmp1[2];
-          memcpy(&data[i], tmp2, 4);           
-        break;
-        case MModBus_32bitOrder_CDAB:
-          memcpy(tmp1, &data[i], 4);       
-          tmp2[0] = tmp1[2];
-          tmp2[1] = tmp1[3];
-          tmp2[2] = tmp1[0];
-          tmp2[3] = tmp1[1];
-          memcpy(&data[i], tmp2, 4);    
-        break;
-        default:
-          
-        break;
-      }        
-    }
-    return true;
-  }
-  else
+  #if( _MMODBUS_RTU == 1)
+  MModBus_Transaction_t transaction;
+  if(mmodbus_readRegisters(&transaction, slaveAddress, MModbusCMD_ReadHoldingRegisters, startnumber, length * 2) == false)
     return false;
+  if(data != NULL)
+    mmodbus_getRegisters32f(&transaction, data);
+  return true;
+  #endif
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegister32i(uint8_t slaveAddress, uint16_t number, uint32_t *data)
 {
-  return mmodbus_readHoldingRegisters32i(slaveAddress, number, 1, data); 
+  return mmodbus_readHoldingRegisters32i(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegisters32i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint32_t *data)
 {
-  return mmodbus_readHoldingRegisters32f(slaveAddress, startnumber, length, (float*)data);
+  #if( _MMODBUS_RTU == 1)
+  MModBus_Transaction_t transaction;
+  if(mmodbus_readRegisters(&transaction, slaveAddress, MModbusCMD_ReadHoldingRegisters, startnumber, length * 2) == false)
+    return false;
+  if(data != NULL)
+    mmodbus_getRegisters32i(&transaction, data);
+  return true;
+  #endif
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegister16i(uint8_t slaveAddress, uint16_t number, uint16_t *data)
 {
-  return mmodbus_readHoldingRegisters16i(slaveAddress, number, 1, data); 
+  return mmodbus_readHoldingRegisters16i(slaveAddress, number, 1, data);
 }
 //##################################################################################################
 bool mmodbus_readHoldingRegisters16i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint16_t *data)
 {
-  bool ret = mmodbus_readHoldingRegisters8i(slaveAddress, startnumber, length * 1, (uint8_t*)data);
-  if(ret == true)
-  {
-    uint8_t tmp1[2],tmp2[2];
-    for(uint16_t i=0 ; i<length ; i++)
-    {   
-      switch(mmodbus.byteOrder16)
-      {
-        case MModBus_16bitOrder_AB:
-          memcpy(tmp1, &data[i], 2);       
-          tmp2[0] = tmp1[0];
-          tmp2[1] = tmp1[1];
-          memcpy(&data[i], tmp2, 2);    
-        break;
-        default:
-          memcpy(tmp1, &data[i], 2);       
-          tmp2[0] = tmp1[1];
-          tmp2[1] = tmp1[0];
-          memcpy(&data[i], tmp2, 2);    
-        break;
-      }
-    }
-    return true;
-  }
-  else
+  #if( _MMODBUS_RTU == 1)
+  MModBus_Transaction_t transaction;
+  if(mmodbus_readRegisters(&transaction, slaveAddress, MModbusCMD_ReadHoldingRegisters, startnumber, length * 1) == false)
     return false;
+  if(data != NULL)
+    mmodbus_getRegisters16i(&transaction, data);
+  return true;
+  #endif
 }
 //##################################################################################################
 bool mmodbus_writeCoil(uint8_t slaveAddress, uint16_t number, uint8_t data)
 {
   #if( _MMODBUS_RTU == 1)
-  uint8_t txData[8];
-  txData[0] = slaveAddress;
-  txData[1] = MModbusCMD_WriteSingleCoil;
-  txData[2] = (number & 0xFF00) >> 8;
-  txData[3] = (number & 0x00FF);
-  if(data == 0)
-    txData[4] = 0;
-  else
-    txData[4] = 0xFF;
-  txData[5] = 0;
-  static uint16_t  crc;
-  crc = mmodbus_crc16(txData, 6);
-  txData[6] = (crc & 0x00FF);
-  txData[7] = (crc & 0xFF00) >> 8;
-  mmodbus_sendRaw(txData, 8, 100);
-  uint16_t recLen = mmodbus_receiveRaw(8, mmodbus.timeout);
-  if(recLen == 0)
-    return false;
-  if(memcmp(txData, mmodbus.rxBuf, 8) == 0)
-    return true;
-  else
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareWriteSingle(&transaction, slaveAddress, MModbusCMD_WriteSingleCoil, number, (data == 0) ? 0 : 0xFF00) == false)
     return false;
+  return mmodbus_execute(&transaction);
   #endif
   #if( _MMODBUS_ASCII == 1)
-  
+
   #endif
 }
 //##################################################################################################
 bool mmodbus_writeHoldingRegister16i(uint8_t slaveAddress, uint16_t number, uint16_t data)
 {
   #if( _MMODBUS_RTU == 1)
-  uint8_t txData[8];
-  txData[0] = slaveAddress;
-  txData[1] = MModbusCMD_WriteSingleRegister;
-  txData[2] = (number & 0xFF00) >> 8;
-  txData[3] = (number & 0x00FF);
-  txData[4] = (data & 0xFF00) >> 8;
-  txData[5] = data & 0x00FF;
-  static uint16_t  crc;
-  crc = mmodbus_crc16(txData, 6);
-  txData[6] = (crc & 0x00FF);
-  txData[7] = (crc & 0xFF00) >> 8;
-  mmodbus_sendRaw(txData, 8, 100);
-  uint16_t recLen = mmodbus_receiveRaw(8, mmodbus.timeout);
-  if(recLen == 0)
-    return false;
-  if(memcmp(txData, mmodbus.rxBuf, 8) == 0)
-    return true;
-  else
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareWriteSingle(&transaction, slaveAddress, MModbusCMD_WriteSingleRegister, number, data) == false)
     return false;
+  return mmodbus_execute(&transaction);
   #endif
   #if( _MMODBUS_ASCII == 1)
-  
+
   #endif
 }
 //##################################################################################################
-/*
 bool mmodbus_writeHoldingRegisters16i(uint8_t slaveAddress, uint16_t startnumber, uint16_t length, uint16_t *data)
 {
   #if( _MMODBUS_RTU == 1)
-	if (length==1)
-	{
-		return mmodbus_writeHoldingRegister16i(slaveAddress, startnumber, data[0]);
-	}
-	else
-	{
-	  uint8_t txData[7 + length * 2 + 2];
-	  txData[0] = slaveAddress;
-	  txData[1] = MModbusCMD_WriteMultipleRegisters;
-	  txData[2] = (startnumber & 0xFF00) >> 8;
-	  txData[3] = (startnumber & 0x00FF);
-	  txData[4] = (length & 0xFF00) >> 8;
-	  txData[5] = (length & 0x00FF);
-	  txData[6] = (length * 2);
-	  uint8_t tmp1[2],tmp2[2];
-	  for(uint16_t i=0 ; i<length ; i++)
-	  {   
-      switch(mmodbus.byteOrder16)
-      {
-        case MModBus_16bitOrder_AB:
-        memcpy(tmp1, &data[i], 2);       
-        tmp2[0] = tmp1[1];
-        tmp2[1] = tmp1[0];
-        memcpy(&txData[7 + i * 2], tmp2, 2);    
-        break;
-        default:
-        memcpy(tmp1, &data[i], 2);       
-        tmp2[0] = tmp1[0];
-        tmp2[1] = tmp1[1];
-        memcpy(&txData[7 + i * 2], tmp2, 2);    
-        break;
-      }
-	  }    
-	  static uint16_t crc;
-	  crc = mmodbus_crc16(txData, 7 + length * 2);
-	  txData[7 + length * 2 + 0] = (crc & 0x00FF);
-	  txData[7 + length * 2 + 1] = (crc & 0xFF00) >> 8;
-	  mmodbus_sendRaw(txData, 7 + length * 2 + 2, 100);
-	  uint16_t recLen = mmodbus_receiveRaw(8, mmodbus.timeout);
-	  if(recLen == 0)
-      return false;
-	  crc = mmodbus_crc16(txData, 6);
-	  txData[6] = (crc & 0x00FF);
-	  txData[7] = (crc & 0xFF00) >> 8;  
-	  if(memcmp(txData, mmodbus.rxBuf, 8) == 0)
-      return true;
-	  else
-      return false;
-	}
+  if (length==1)
+    return mmodbus_writeHoldingRegister16i(slaveAddress, startnumber, data[0]);
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareWriteMultipleRegisters(&transaction, slaveAddress, startnumber, length, data) == false)
+    return false;
+  return mmodbus_execute(&transaction);
   #endif
   #if( _MMODBUS_ASCII == 1)
-  
+
   #endif
 }
-*/
 //##################################################################################################
-
 bool mmodbus_writeHoldingRegisters16i_length2(uint8_t slaveAddress, uint16_t startnumber, uint16_t *data)
 {
-  uint8_t length = 2;
-
-	  uint8_t txData[7 + length * 2 + 2];
-	  txData[0] = slaveAddress;
-	  txData[1] = MModbusCMD_WriteMultipleRegisters;
-	  txData[2] = (startnumber & 0xFF00) >> 8;
-	  txData[3] = (startnumber & 0x00FF);
-	  txData[4] = (length & 0xFF00) >> 8;
-	  txData[5] = (length & 0x00FF);
-	  txData[6] = (length * 2);
-	  uint8_t tmp1[2],tmp2[2];
-	  for(uint16_t i=0 ; i<length ; i++)
-	  {   
-      switch(mmodbus.byteOrder16)
-      {
-        case MModBus_16bitOrder_AB:
-        memcpy(tmp1, &data[i], 2);       
-        tmp2[0] = tmp1[1];
-        tmp2[1] = tmp1[0];
-        memcpy(&txData[7 + i * 2], tmp2, 2);    
-        break;
-        default:
-        memcpy(tmp1, &data[i], 2);       
-        tmp2[0] = tmp1[0];
-        tmp2[1] = tmp1[1];
-        memcpy(&txData[7 + i * 2], tmp2, 2);    
-        break;
-      }
-	  }    
-	  static uint16_t crc;
-	  crc = mmodbus_crc16(txData, 7 + length * 2);
-	  txData[7 + length * 2 + 0] = (crc & 0x00FF);
-	  txData[7 + length * 2 + 1] = (crc & 0xFF00) >> 8;
-	  mmodbus_sendRaw(txData, 7 + length * 2 + 2, 100);
-	  uint16_t recLen = mmodbus_receiveRaw(8, mmodbus.timeout);
-	  if(recLen == 0)
-      return false;
-	  crc = mmodbus_crc16(txData, 6);
-	  txData[6] = (crc & 0x00FF);
-	  txData[7] = (crc & 0xFF00) >> 8;  
-	  if(memcmp(txData, mmodbus.rxBuf, 8) == 0)
-      return true;
-	  else
-      return false;
+  MModBus_Transaction_t transaction;
+  if(mmodbus_prepareWriteMultipleRegisters(&transaction, slaveAddress, startnumber, 2, data) == false)
+    return false;
+  return mmodbus_execute(&transaction);
 }
 //##################################################################################################
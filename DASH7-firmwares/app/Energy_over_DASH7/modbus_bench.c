@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdlib.h>
+#include "modbus_bench.h"
+#include "mmodbus.h"
+#include "modbus_bus.h"
+#include "AcuRev_1312_RCT.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "log.h"
+
+#define MODBUS_BENCH_BUSY_DELAY 3 // timer ticks to wait when the bus or the meter driver is busy
+#define MODBUS_BENCH_SUITE_SAMPLES 50
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+// a measurement reads every quantity of the three phases and its scale factor
+#define MODBUS_BENCH_QUANTITY_REGISTERS(name, first, width, raw_type, scale_register, exponent, type) \
+    + 3 * (width) / 16 + 1
+#define MODBUS_BENCH_CYCLE_REGISTERS (0 ACUREV_QUANTITIES(MODBUS_BENCH_QUANTITY_REGISTERS))
+
+static const uint8_t bench_block_length[MODBUS_BENCH_WORKLOAD_COUNT] = {
+    [MODBUS_BENCH_SINGLE] = 1,
+    [MODBUS_BENCH_BLOCK4] = 4,
+    [MODBUS_BENCH_BLOCK125] = 125,
+};
+
+static const char* const bench_workload_names[MODBUS_BENCH_WORKLOAD_COUNT] = {
+    [MODBUS_BENCH_SINGLE] = "single",
+    [MODBUS_BENCH_BLOCK4] = "block4",
+    [MODBUS_BENCH_BLOCK125] = "block125",
+    [MODBUS_BENCH_CYCLE] = "cycle",
+};
+
+static MModBus_Transaction_t bench_transaction;
+static acurev_values_t bench_values;
+static bool bench_busy;
+static uint8_t bench_slave_address;
+static modbus_bench_workload_t bench_workload;
+static uint16_t bench_samples;
+static uint16_t bench_sample;
+static timer_tick_t bench_start;
+static timer_tick_t bench_sample_start;
+static uint16_t bench_latency[MODBUS_BENCH_MAX_SAMPLES];
+static uint16_t bench_requests;
+static uint32_t bench_awake;
+static modbus_bench_result_t bench_result;
+static modbus_bench_callback_t bench_callback;
+
+static uint8_t suite_slave_address;
+static uint8_t suite_workload;
+static bool suite_running;
+static bool suite_sweep;
+static uint32_t suite_baudrate; // the rate the workloads last ran at
+static uint32_t suite_top_baudrate; // the rate the meter got found at, where the sweep leaves it
+
+static void modbus_bench_start_sample();
+
+void modbus_bench_init()
+{
+    // the uart and mmodbus itself are set up by the meter driver, the benchmark shares that bus
+    sched_register_task(&modbus_bench_start_sample);
+}
+
+const char* modbus_bench_workload_name(modbus_bench_workload_t workload)
+{
+    return (workload < MODBUS_BENCH_WORKLOAD_COUNT) ? bench_workload_names[workload] : "unknown";
+}
+
+static uint16_t modbus_bench_requests()
+{
+    MModBus_Statistics_t stats;
+
+    mmodbus_getStatistics(&stats);
+    return stats.requests;
+}
+
+// nearest rank, the latencies are sorted
+static uint32_t modbus_bench_percentile(uint8_t percent)
+{
+    uint16_t rank = ((uint32_t)bench_samples * percent + 99) / 100;
+    return bench_latency[(rank > 0) ? rank - 1 : 0];
+}
+
+static void modbus_bench_finish()
+{
+    // insertion sort, there are only a handful of samples
+    for (uint16_t i = 1; i < bench_samples; i++) {
+        uint16_t latency = bench_latency[i];
+        uint16_t j = i;
+        for (; (j > 0) && (bench_latency[j - 1] > latency); j--)
+            bench_latency[j] = bench_latency[j - 1];
+        bench_latency[j] = latency;
+    }
+
+    bench_result.samples = bench_samples;
+    // the request counter of mmodbus is 16 bit, the difference survives a wrap
+    bench_result.transactions = (uint16_t)(modbus_bench_requests() - bench_requests);
+    bench_result.elapsed = timer_get_counter_value() - bench_start;
+    bench_result.latency_p50 = modbus_bench_percentile(50);
+    bench_result.latency_p99 = modbus_bench_percentile(99);
+    bench_result.awake = mmodbus_getAwakeTicks() - bench_awake;
+    bench_busy = false;
+    if (bench_callback)
+        bench_callback(&bench_result);
+}
+
+static void modbus_bench_sample_done(bool success)
+{
+    bench_latency[bench_sample] = timer_get_counter_value() - bench_sample_start;
+    if (success)
+        bench_result.registers += (bench_workload == MODBUS_BENCH_CYCLE) ? MODBUS_BENCH_CYCLE_REGISTERS
+                                                                         : bench_block_length[bench_workload];
+    else
+        bench_result.failures++;
+
+    bench_sample++;
+    if (bench_sample < bench_samples)
+        modbus_bench_start_sample();
+    else
+        modbus_bench_finish();
+}
+
+static void modbus_bench_transaction_done(MModBus_Transaction_t* transaction)
+{
+    modbus_bench_sample_done(transaction->success);
+}
+
+static void modbus_bench_start_sample()
+{
+    bool started;
+
+    bench_sample_start = timer_get_counter_value();
+    if (bench_workload == MODBUS_BENCH_CYCLE)
+        started = acurev_get_values(bench_slave_address, &bench_values, &modbus_bench_sample_done);
+    else {
+        mmodbus_prepareRead(&bench_transaction, bench_slave_address, MModbusCMD_ReadHoldingRegisters,
+            MODBUS_BENCH_FIRST_REGISTER, bench_block_length[bench_workload]);
+        bench_transaction.callback = &modbus_bench_transaction_done;
+        started = modbus_bus_submit(&bench_transaction, MODBUS_BUS_PRIORITY_POLL, MODBUS_BUS_NO_DEADLINE);
+    }
+    // the queue of the bus is full or the meter driver is still busy, try again a bit later
+    if (!started)
+        timer_post_task_delay(&modbus_bench_start_sample, MODBUS_BENCH_BUSY_DELAY);
+}
+
+/**
+ * @brief Run the samples of a workload back to back and measure them
+ * The single register and block workloads read from MODBUS_BENCH_FIRST_REGISTER on without retries, the cycle
+ * workload does a full measurement through the AcuRev driver, retries included
+ * @param slave_address the meter to read from
+ * @param samples number of transactions or measurements, at most MODBUS_BENCH_MAX_SAMPLES
+ * @param callback gets the result once all samples are done
+ * @return false if a benchmark is still running or the arguments are out of range
+ */
+bool modbus_bench_run(uint8_t slave_address, modbus_bench_workload_t workload, uint16_t samples,
+    modbus_bench_callback_t callback)
+{
+    if (bench_busy || (workload >= MODBUS_BENCH_WORKLOAD_COUNT) || (samples == 0)
+        || (samples > MODBUS_BENCH_MAX_SAMPLES))
+        return false;
+    bench_busy = true;
+    bench_slave_address = slave_address;
+    bench_workload = workload;
+    bench_samples = samples;
+    bench_sample = 0;
+    bench_callback = callback;
+    bench_result = (modbus_bench_result_t) { .workload = workload };
+    bench_requests = modbus_bench_requests();
+    bench_awake = mmodbus_getAwakeTicks();
+    bench_start = timer_get_counter_value();
+    modbus_bench_start_sample();
+    return true;
+}
+
+static void modbus_bench_suite_next_rate();
+
+static void modbus_bench_suite_next(const modbus_bench_result_t* result)
+{
+    uint32_t elapsed = result->elapsed ? result->elapsed : 1;
+
+    log_print_string("bench %s at %d baud: %d samples, %d failed, %d transactions/s, %d registers/s, "
+                     "p50 %d ms, p99 %d ms, %d us awake per sample",
+        modbus_bench_workload_name(result->workload), acurev_get_baudrate(), result->samples, result->failures,
+        result->transactions * TIMER_TICKS_PER_SEC / elapsed, result->registers * TIMER_TICKS_PER_SEC / elapsed,
+        result->latency_p50 * 1000 / TIMER_TICKS_PER_SEC, result->latency_p99 * 1000 / TIMER_TICKS_PER_SEC,
+        (uint32_t)((uint64_t)result->awake * 1000000 / TIMER_TICKS_PER_SEC / result->samples));
+
+    suite_workload++;
+    if (suite_workload < MODBUS_BENCH_WORKLOAD_COUNT)
+        modbus_bench_run(suite_slave_address, suite_workload, MODBUS_BENCH_SUITE_SAMPLES, &modbus_bench_suite_next);
+    else
+        modbus_bench_suite_next_rate();
+}
+
+static void modbus_bench_suite_restored(uint32_t baudrate)
+{
+    log_print_string("bench done, meter at %d baud", baudrate);
+    suite_running = false;
+}
+
+static void modbus_bench_suite_finish()
+{
+    if (!suite_sweep || (acurev_get_baudrate() == suite_top_baudrate)) {
+        suite_running = false;
+        return;
+    }
+    // climbs back one rate at a time, each only kept when it reads clean like at boot
+    acurev_negotiate_baudrate(suite_slave_address, acurev_get_baudrate(), suite_top_baudrate, &modbus_bench_suite_restored);
+}
+
+static void modbus_bench_suite_start_rate();
+
+static void modbus_bench_suite_rate_moved(uint32_t baudrate)
+{
+    if (baudrate == 0) {
+        log_print_error_string("bench lost the meter, sweep stopped");
+        suite_running = false;
+        return;
+    }
+    // the meter did not take the lower rate, the sweep ends on the one it is at
+    if (baudrate >= suite_baudrate) {
+        modbus_bench_suite_finish();
+        return;
+    }
+    modbus_bench_suite_start_rate();
+}
+
+static void modbus_bench_suite_start_rate()
+{
+    suite_baudrate = acurev_get_baudrate();
+    suite_workload = 0;
+    modbus_bench_run(suite_slave_address, suite_workload, MODBUS_BENCH_SUITE_SAMPLES, &modbus_bench_suite_next);
+}
+
+static void modbus_bench_suite_next_rate()
+{
+    uint32_t lower = acurev_get_lower_baudrate(suite_baudrate);
+
+    if (!suite_sweep || (lower >= suite_baudrate)) {
+        modbus_bench_suite_finish();
+        return;
+    }
+    // a ceiling under the current rate moves the meter down a single rate
+    acurev_negotiate_baudrate(suite_slave_address, suite_baudrate, lower, &modbus_bench_suite_rate_moved);
+}
+
+/**
+ * @brief Run every workload once on the current rate of the bus and log the results, for a build with a meter attached
+ * With sweep set, the meter then steps down through every lower rate and the workloads run again on each one, after
+ * which the meter goes back to the rate it started at. Only do that when it is the only device on the bus.
+ * @return false if the suite is still running
+ */
+bool modbus_bench_start_suite(uint8_t slave_address, bool sweep)
+{
+    if (suite_running || bench_busy)
+        return false;
+    suite_running = true;
+    suite_slave_address = slave_address;
+    suite_sweep = sweep;
+    suite_top_baudrate = acurev_get_baudrate();
+    modbus_bench_suite_start_rate();
+    return true;
+}
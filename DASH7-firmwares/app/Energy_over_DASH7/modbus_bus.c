@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdlib.h>
+#include "modbus_bus.h"
+#include "hwuart.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "log.h"
+
+#define MODBUS_BUS_RETRY_DELAY 3 // timer ticks to wait when a local master is using the bus
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+typedef struct {
+    MModBus_Transaction_t* transaction;
+    MModBus_Callback_t callback; // of the driver, the bus takes the place of it while the transaction runs
+    uint8_t priority;
+    bool has_deadline;
+    timer_tick_t deadline;
+    uint16_t sequence; // keeps the order of submission among equal priorities and deadlines
+} modbus_bus_entry_t;
+
+static uart_handle_t* uart;
+static modbus_bus_entry_t bus_queue[MODBUS_BUS_MAX_QUEUED];
+static uint8_t bus_queue_count;
+static modbus_bus_entry_t bus_active;
+static bool bus_running;
+static uint16_t bus_sequence;
+
+static void modbus_bus_schedule();
+
+static void modbus_bus_open_uart(uint32_t baudrate)
+{
+    uart = uart_init(0, baudrate, 0);
+    uart_enable(uart);
+    // without a DMA channel every received byte is handed over by the uart interrupt, with one it only carries
+    // the requests of a local master, mmodbus switches it off while receiving its own responses
+    uart_set_rx_interrupt_callback(uart, &modbus_callback_stack);
+    uart_rx_interrupt_enable(uart);
+}
+
+/**
+ * @brief Open the uart of the bus, all drivers share it through modbus_bus_submit
+ * @param timeout default ms to wait for an answer, the drivers can change it per transaction
+ */
+void modbus_bus_init(uint32_t baudrate, uint32_t timeout)
+{
+    modbus_bus_open_uart(baudrate);
+    mmodbus_init(timeout);
+    mmodbus_setBaudrate(baudrate);
+    sched_register_task(&modbus_bus_schedule);
+}
+
+/**
+ * @brief Move the bus to another rate, only in between transactions like from a transaction callback
+ */
+void modbus_bus_set_baudrate(uint32_t baudrate)
+{
+    uart_disable(uart);
+    modbus_bus_open_uart(baudrate);
+    mmodbus_setBaudrate(baudrate);
+}
+
+bool modbus_bus_is_idle()
+{
+    return !bus_running && (bus_queue_count == 0);
+}
+
+// true if entry a has to go on the bus before entry b
+static bool modbus_bus_before(const modbus_bus_entry_t* a, const modbus_bus_entry_t* b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    if (a->has_deadline != b->has_deadline)
+        return a->has_deadline;
+    if (a->has_deadline && (a->deadline != b->deadline))
+        return (int32_t)(a->deadline - b->deadline) < 0;
+    return (int16_t)(a->sequence - b->sequence) < 0;
+}
+
+static void modbus_bus_remove(uint8_t index)
+{
+    bus_queue[index] = bus_queue[--bus_queue_count];
+}
+
+// transactions that did not get on the bus in time fail without being sent
+static void modbus_bus_expire()
+{
+    timer_tick_t now = timer_get_counter_value();
+
+    for (uint8_t i = 0; i < bus_queue_count;) {
+        modbus_bus_entry_t entry = bus_queue[i];
+        if (!entry.has_deadline || ((int32_t)(now - entry.deadline) < 0)) {
+            i++;
+            continue;
+        }
+        modbus_bus_remove(i);
+        log_print_error_string("transaction to slave %d missed its deadline", entry.transaction->txBuf[0]);
+        entry.transaction->state = MModBus_TransactionState_Done;
+        entry.transaction->success = false;
+        entry.transaction->status = MModBus_Status_Timeout;
+        entry.transaction->callback = entry.callback;
+        if (entry.callback)
+            entry.callback(entry.transaction);
+    }
+}
+
+static void modbus_bus_done(MModBus_Transaction_t* transaction)
+{
+    transaction->callback = bus_active.callback;
+    bus_running = false;
+    // the driver usually queues its next transaction from here, it competes with the others at this frame boundary
+    if (transaction->callback)
+        transaction->callback(transaction);
+    sched_post_task(&modbus_bus_schedule);
+}
+
+static void modbus_bus_schedule()
+{
+    uint8_t next = 0;
+    uint32_t silence;
+
+    if (bus_running || mmodbus_isBusy())
+        return;
+    modbus_bus_expire();
+    if (bus_queue_count == 0)
+        return;
+
+    // wait for the end of the previous frame on the timer instead of spinning in mmodbus
+    silence = mmodbus_getSilenceLeft();
+    if (silence > 0) {
+        timer_post_task_delay(&modbus_bus_schedule, silence);
+        return;
+    }
+
+    for (uint8_t i = 1; i < bus_queue_count; i++)
+        if (modbus_bus_before(&bus_queue[i], &bus_queue[next]))
+            next = i;
+    bus_active = bus_queue[next];
+    bus_active.transaction->callback = &modbus_bus_done;
+    if (!mmodbus_submit(bus_active.transaction)) {
+        // a local master is talking, the queue stays as it is
+        bus_active.transaction->callback = bus_active.callback;
+        timer_post_task_delay(&modbus_bus_schedule, MODBUS_BUS_RETRY_DELAY);
+        return;
+    }
+    modbus_bus_remove(next);
+    bus_running = true;
+}
+
+/**
+ * @brief Queue a prepared transaction, its callback gets called once it got answered or failed
+ * Only whole transactions get ordered, a running transaction always finishes before the next one starts. So an
+ * urgent transaction waits at most for the one on the bus.
+ * @param transaction prepared by one of the mmodbus_prepare* functions, with its callback set
+ * @param priority transactions with a higher priority go first, equal ones in order of their deadline
+ * @param deadline ms from now after which the transaction fails without being sent, MODBUS_BUS_NO_DEADLINE to wait
+ * as long as it takes
+ * @return false if the transaction is already queued or the queue is full
+ */
+bool modbus_bus_submit(MModBus_Transaction_t* transaction, modbus_bus_priority_t priority, uint32_t deadline)
+{
+    if (bus_queue_count >= MODBUS_BUS_MAX_QUEUED)
+        return false;
+    if (bus_running && (bus_active.transaction == transaction))
+        return false;
+    for (uint8_t i = 0; i < bus_queue_count; i++)
+        if (bus_queue[i].transaction == transaction)
+            return false;
+
+    transaction->state = MModBus_TransactionState_Busy;
+    bus_queue[bus_queue_count++] = (modbus_bus_entry_t) {
+        .transaction = transaction,
+        .callback = transaction->callback,
+        .priority = priority,
+        .has_deadline = (deadline != MODBUS_BUS_NO_DEADLINE),
+        .deadline = timer_get_counter_value() + (deadline * TIMER_TICKS_PER_SEC + 999) / 1000,
+        .sequence = bus_sequence++,
+    };
+    sched_post_task(&modbus_bus_schedule);
+    return true;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include "modbus_capture.h"
+#include "SEGGER_RTT.h"
+#include "hwatomic.h"
+#include "stm32_device.h"
+#include "stm32l0xx_ll_bus.h"
+#include "stm32l0xx_ll_tim.h"
+
+// free running us counter, the overflow interrupt extends it to 32 bits
+#define MODBUS_CAPTURE_TIMER TIM22
+#define MODBUS_CAPTURE_TIMER_IRQn TIM22_IRQn
+#define MODBUS_CAPTURE_TIMER_IRQHandler TIM22_IRQHandler
+
+static uint8_t capture_buffer[MODBUS_CAPTURE_BUFFER_SIZE];
+static volatile uint16_t capture_overflows;
+static uint8_t capture_lost;
+
+void MODBUS_CAPTURE_TIMER_IRQHandler()
+{
+    if (LL_TIM_IsActiveFlag_UPDATE(MODBUS_CAPTURE_TIMER)) {
+        LL_TIM_ClearFlag_UPDATE(MODBUS_CAPTURE_TIMER);
+        capture_overflows++;
+    }
+}
+
+/**
+ * @brief Start the us timer and open the RTT channel of the trace
+ * The timer only counts while the core runs, stamps across a stop of the core are meaningless. Capture on a build that
+ * does not stop the core, like the LIQUIBUS_V2 build that logs over RTT.
+ */
+void modbus_capture_init()
+{
+    SEGGER_RTT_ConfigUpBuffer(
+        MODBUS_CAPTURE_RTT_CHANNEL, "modbus", capture_buffer, sizeof(capture_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+
+    LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_TIM22);
+    // the timer runs from the core clock as long as the APB2 prescaler is 1
+    LL_TIM_SetPrescaler(MODBUS_CAPTURE_TIMER, (SystemCoreClock / 1000000) - 1);
+    LL_TIM_SetAutoReload(MODBUS_CAPTURE_TIMER, 0xFFFF);
+    LL_TIM_GenerateEvent_UPDATE(MODBUS_CAPTURE_TIMER);
+    LL_TIM_ClearFlag_UPDATE(MODBUS_CAPTURE_TIMER);
+    LL_TIM_EnableIT_UPDATE(MODBUS_CAPTURE_TIMER);
+    NVIC_SetPriority(MODBUS_CAPTURE_TIMER_IRQn, 0);
+    NVIC_EnableIRQ(MODBUS_CAPTURE_TIMER_IRQn);
+    LL_TIM_EnableCounter(MODBUS_CAPTURE_TIMER);
+}
+
+static uint32_t modbus_capture_timestamp()
+{
+    uint32_t overflows = capture_overflows;
+    uint16_t count = LL_TIM_GetCounter(MODBUS_CAPTURE_TIMER);
+    // the counter wrapped but the interrupt did not run yet, like when called with interrupts disabled
+    if (LL_TIM_IsActiveFlag_UPDATE(MODBUS_CAPTURE_TIMER) && (count < 0x8000))
+        overflows++;
+    return (overflows << 16) | count;
+}
+
+/**
+ * @brief Add a record to the trace, from the uart interrupt as well as from tasks
+ * Records that do not fit in the RTT buffer get dropped, the next record that fits is preceded by a count of them
+ */
+void modbus_capture_record(uint8_t type, uint8_t value)
+{
+    modbus_capture_record_t record;
+
+    start_atomic();
+    record.timestamp = modbus_capture_timestamp();
+    if (capture_lost > 0) {
+        record.type = MODBUS_CAPTURE_LOST;
+        record.value = capture_lost;
+        if (SEGGER_RTT_Write(MODBUS_CAPTURE_RTT_CHANNEL, &record, sizeof(record)) == 0) {
+            capture_lost += (capture_lost < 0xFF);
+            end_atomic();
+            return;
+        }
+        capture_lost = 0;
+    }
+    record.type = type;
+    record.value = value;
+    if (SEGGER_RTT_Write(MODBUS_CAPTURE_RTT_CHANNEL, &record, sizeof(record)) == 0)
+        capture_lost += (capture_lost < 0xFF);
+    end_atomic();
+}
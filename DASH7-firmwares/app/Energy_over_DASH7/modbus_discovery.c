@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdlib.h>
+#include "modbus_discovery.h"
+#include "mmodbus.h"
+#include "modbus_bus.h"
+#include "AcuRev_1312_RCT.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "log.h"
+
+#define DISCOVERY_PROBE_REGISTER 4219 // scale factor of the AcuRev real energy, always between -3 and 0
+#define DISCOVERY_INITIAL_TIMEOUT 100 // ms besides the wire time mmodbus waits for, most slaves answer well within this
+#define DISCOVERY_MIN_TIMEOUT 6 // ms besides the wire time
+#define DISCOVERY_PROBE_BITS 150 // a probe and its answer on the wire, 15 characters of 10 bits
+#define DISCOVERY_TIMEOUT_MARGIN 3 // the timeout is this many times the slowest turnaround seen so far
+#define DISCOVERY_MAX_RETRIES 1 // only for garbled answers, a silent address gets probed once
+#define DISCOVERY_BUSY_DELAY 3 // timer ticks to wait when the queue of the bus is full
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+static MModBus_Transaction_t discovery_transaction;
+static bool discovery_busy;
+static uint8_t discovery_address;
+static uint8_t discovery_first_address;
+static uint8_t discovery_last_address;
+static uint8_t retry_counter;
+static uint32_t discovery_timeout;
+static uint32_t discovery_slowest;
+static uint32_t discovery_baudrate;
+static uint32_t discovery_home_baudrate; // the rate of the meters, the bus goes back to it after the scan
+static modbus_discovery_device_t* discovery_devices;
+static uint8_t discovery_max_devices;
+static uint8_t discovery_device_count;
+static modbus_discovery_callback_t discovery_callback;
+
+static void modbus_discovery_submit_probe();
+static void modbus_discovery_probe_done(MModBus_Transaction_t* transaction);
+
+void modbus_discovery_init()
+{
+    // the uart and mmodbus itself are set up by the meter driver, the scan shares that bus
+    sched_register_task(&modbus_discovery_submit_probe);
+}
+
+static void modbus_discovery_probe_next()
+{
+    mmodbus_prepareRead(&discovery_transaction, discovery_address, MModbusCMD_ReadHoldingRegisters, DISCOVERY_PROBE_REGISTER, 1);
+    discovery_transaction.timeout = discovery_timeout;
+    discovery_transaction.callback = &modbus_discovery_probe_done;
+    modbus_discovery_submit_probe();
+}
+
+static void modbus_discovery_submit_probe()
+{
+    // the queue of the bus is full, try again a bit later
+    if (!modbus_bus_submit(&discovery_transaction, MODBUS_BUS_PRIORITY_POLL, MODBUS_BUS_NO_DEADLINE))
+        timer_post_task_delay(&modbus_discovery_submit_probe, DISCOVERY_BUSY_DELAY);
+}
+
+// ms the probe and its answer take on the wire at the rate of this pass
+static uint32_t modbus_discovery_wire_time()
+{
+    return (DISCOVERY_PROBE_BITS * 1000 + discovery_baudrate - 1) / discovery_baudrate;
+}
+
+// the rate after the one just scanned: the rate of the meters first, then all others from fast to slow, 0 when done
+static uint32_t modbus_discovery_next_baudrate()
+{
+    uint32_t next = (discovery_baudrate == discovery_home_baudrate) ? UINT32_MAX : discovery_baudrate;
+    uint32_t lower;
+
+    do {
+        lower = acurev_get_lower_baudrate(next);
+        if (lower >= next)
+            return 0;
+        next = lower;
+    } while (next == discovery_home_baudrate);
+    return next;
+}
+
+static void modbus_discovery_start_pass(uint32_t baudrate)
+{
+    if (baudrate != discovery_baudrate)
+        modbus_bus_set_baudrate(baudrate);
+    discovery_baudrate = baudrate;
+    discovery_address = discovery_first_address;
+    discovery_timeout = DISCOVERY_INITIAL_TIMEOUT;
+    discovery_slowest = 0;
+    retry_counter = 0;
+    DPRINT("scanning slaves %d to %d at %d baud", discovery_first_address, discovery_last_address, baudrate);
+    modbus_discovery_probe_next();
+}
+
+static void modbus_discovery_add_device(MModBus_Transaction_t* transaction)
+{
+    modbus_discovery_device_t* device = &discovery_devices[discovery_device_count++];
+    // from the moment the probe went on the bus, waiting behind other transactions is no latency of the slave
+    uint32_t latency = (timer_get_counter_value() - mmodbus_getTxTick()) * 1000 / TIMER_TICKS_PER_SEC;
+    uint32_t wire = modbus_discovery_wire_time();
+    uint16_t raw_scale;
+
+    device->address = discovery_address;
+    device->baudrate = discovery_baudrate;
+    device->type = MODBUS_METER_TYPE_UNKNOWN;
+    if (transaction->success) {
+        mmodbus_getRegisterRange16i(transaction, 0, 1, &raw_scale);
+        if (((int16_t)raw_scale >= -3) && ((int16_t)raw_scale <= 0))
+            device->type = MODBUS_METER_TYPE_ACUREV_1312;
+    }
+    device->latency = (latency > UINT8_MAX) ? UINT8_MAX : latency;
+
+    // the answers seen so far tell how long it is worth waiting on the next addresses,
+    // mmodbus already waits for the frames themselves
+    if ((latency > wire) && (latency - wire > discovery_slowest))
+        discovery_slowest = latency - wire;
+    discovery_timeout = discovery_slowest * DISCOVERY_TIMEOUT_MARGIN;
+    if (discovery_timeout < DISCOVERY_MIN_TIMEOUT)
+        discovery_timeout = DISCOVERY_MIN_TIMEOUT;
+    if (discovery_timeout > DISCOVERY_INITIAL_TIMEOUT)
+        discovery_timeout = DISCOVERY_INITIAL_TIMEOUT;
+
+    DPRINT("found slave %d at %d baud, type %d, answered in %d ms", device->address, discovery_baudrate, device->type,
+        latency);
+}
+
+static void modbus_discovery_probe_done(MModBus_Transaction_t* transaction)
+{
+    retry_counter++;
+    // an exception still proves a slave is listening on this address
+    if (transaction->success || (transaction->status == MModBus_Status_Exception))
+        modbus_discovery_add_device(transaction);
+    else if ((transaction->status != MModBus_Status_Timeout) && (retry_counter <= DISCOVERY_MAX_RETRIES)) {
+        // something answered, but garbled, give it one more chance
+        modbus_discovery_submit_probe();
+        return;
+    }
+
+    // the next probe goes out right away, there is no reason to leave the bus idle
+    if ((discovery_address < discovery_last_address) && (discovery_device_count < discovery_max_devices)) {
+        discovery_address++;
+        retry_counter = 0;
+        modbus_discovery_probe_next();
+        return;
+    }
+
+    // nothing answered at this rate, the slaves might talk at another one
+    if ((discovery_device_count == 0) && (modbus_discovery_next_baudrate() != 0)) {
+        modbus_discovery_start_pass(modbus_discovery_next_baudrate());
+        return;
+    }
+    if (discovery_baudrate != discovery_home_baudrate)
+        modbus_bus_set_baudrate(discovery_home_baudrate);
+    discovery_busy = false;
+    DPRINT("scan done, found %d slaves", discovery_device_count);
+    if (discovery_callback)
+        discovery_callback(discovery_device_count);
+}
+
+/**
+ * @brief Probe every address in a range with a read of a single register
+ * A slave that answers, even with an exception, gets reported. The timeout starts at DISCOVERY_INITIAL_TIMEOUT and
+ * shrinks to a few times the slowest answer seen so far, which makes a scan of the full bus take seconds. The scan
+ * runs at the rate of the meters first, when nothing answers there it gets repeated at every other rate.
+ * @param first_address first address to probe, at least 1
+ * @param last_address last address to probe, at most 247
+ * @param devices receives the slaves that answered
+ * @param max_devices the scan stops once this many slaves answered
+ * @param callback called with the number of slaves that answered once the scan is done
+ * @return false if a scan is still running or the range is invalid
+ */
+bool modbus_discovery_scan(uint8_t first_address, uint8_t last_address, modbus_discovery_device_t* devices,
+    uint8_t max_devices, modbus_discovery_callback_t callback)
+{
+    if (discovery_busy || (first_address == 0) || (first_address > last_address) || (last_address > 247) || (max_devices == 0))
+        return false;
+    discovery_devices = devices;
+    discovery_max_devices = max_devices;
+    discovery_device_count = 0;
+    discovery_callback = callback;
+    discovery_first_address = first_address;
+    discovery_last_address = last_address;
+    discovery_home_baudrate = acurev_get_baudrate();
+    discovery_baudrate = discovery_home_baudrate;
+    discovery_busy = true;
+    modbus_discovery_start_pass(discovery_baudrate);
+    return true;
+}
@@ -29,6 +29,10 @@
 #include "log.h"
 #include "scheduler.h"
 #include "energy_file.h"
+#include "poll_list_file.h"
+#include "discovery_file.h"
+#include "forward_file.h"
+#include "statistics_file.h"
 #include "d7ap_fs.h"
 
 #define FRAMEWORK_APP_LOG 1
@@ -60,7 +64,13 @@ void bootstrap()
     button_files_initialize();
     button_file_set_measure_state(true);
     energy_files_initialize();
+    poll_list_files_initialize();
+    discovery_file_initialize();
+    forward_files_initialize();
+    statistics_file_initialize();
+#ifndef MODBUS_BENCH
     energy_file_set_measure_state(true);
+#endif
 
     led_flash(1);
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdlib.h>
+#include "modbus_planner.h"
+#include "log.h"
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+/**
+ * @brief Plan the reads that cover all wanted register ranges
+ * Ranges get sorted on their start register and joined into the same read as long as the registers that are read
+ * through in between do not exceed max_gap and the read stays within 125 registers. Taking every range in the
+ * current read for as long as possible gives the minimum number of reads.
+ * @param ranges the wanted register ranges, overlapping ranges are allowed
+ * @param range_count number of ranges, at most MODBUS_PLANNER_MAX_RANGES
+ * @param max_gap number of unwanted registers that is still cheaper to read than to start a new transaction
+ * @param plan receives the reads and for every range the read that holds it
+ * @return false if a range is empty or too long for a single read
+ */
+bool modbus_planner_plan(const modbus_range_t* ranges, uint8_t range_count, uint16_t max_gap, modbus_plan_t* plan)
+{
+    uint8_t order[MODBUS_PLANNER_MAX_RANGES];
+    modbus_range_t* read = NULL;
+    uint32_t end;
+
+    if (range_count > MODBUS_PLANNER_MAX_RANGES)
+        return false;
+
+    // insertion sort on the start register, there are only a handful of ranges
+    for (uint8_t i = 0; i < range_count; i++) {
+        if ((ranges[i].length == 0) || (ranges[i].length > MODBUS_PLANNER_MAX_REGISTERS))
+            return false;
+        uint8_t j = i;
+        for (; (j > 0) && (ranges[order[j - 1]].start > ranges[i].start); j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    plan->read_count = 0;
+    for (uint8_t i = 0; i < range_count; i++) {
+        const modbus_range_t* range = &ranges[order[i]];
+        end = (uint32_t)range->start + range->length;
+        if ((read != NULL) && (range->start <= (uint32_t)read->start + read->length + max_gap)
+            && (end - read->start <= MODBUS_PLANNER_MAX_REGISTERS)) {
+            if (end > (uint32_t)read->start + read->length)
+                read->length = end - read->start;
+        } else {
+            read = &plan->reads[plan->read_count++];
+            *read = *range;
+        }
+        plan->range_read[order[i]] = plan->read_count - 1;
+    }
+
+    DPRINT("planned %d ranges in %d reads", range_count, plan->read_count);
+    return true;
+}
+
+/**
+ * @brief Get the register offset of a wanted range inside the response of the read that holds it
+ */
+uint16_t modbus_planner_range_offset(const modbus_plan_t* plan, const modbus_range_t* ranges, uint8_t range)
+{
+    return ranges[range].start - plan->reads[plan->range_read[range]].start;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdlib.h>
+#include "modbus_poller.h"
+#include "modbus_planner.h"
+#include "mmodbus.h"
+#include "modbus_bus.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "log.h"
+
+#define MODBUS_POLLER_MAX_RETRIES 3
+#define MODBUS_POLLER_RETRY_DELAY 3 // timer ticks between two attempts
+#define MODBUS_POLLER_MAX_GAP 40 // unused registers that are cheaper to read through than to start another transaction
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+// the schedule compiled from the poll list, the reads of every slave follow each other
+static const modbus_poll_entry_t* poller_entries;
+static uint8_t poller_entry_count;
+static modbus_range_t poller_reads[MODBUS_PLANNER_MAX_RANGES];
+static uint8_t poller_read_slave[MODBUS_PLANNER_MAX_RANGES];
+static uint8_t poller_read_count;
+static uint8_t poller_value_index[MODBUS_POLLER_MAX_ENTRIES];
+static uint8_t poller_value_read[MODBUS_POLLER_MAX_ENTRIES];
+static uint16_t poller_value_offset[MODBUS_POLLER_MAX_ENTRIES];
+static uint8_t poller_scale_read[MODBUS_POLLER_MAX_ENTRIES];
+static uint16_t poller_scale_offset[MODBUS_POLLER_MAX_ENTRIES];
+static bool poller_replan;
+
+static MModBus_Transaction_t poller_transaction;
+static uint8_t retry_counter;
+static bool poller_busy;
+static uint8_t poller_read;
+static uint16_t poller_failed_reads; // bit per read of the running cycle
+static int16_t poller_scale[MODBUS_POLLER_MAX_ENTRIES];
+static int64_t* poller_values;
+static uint8_t* poller_valid_entries;
+static modbus_poller_callback_t poller_callback;
+
+static void modbus_poller_submit_request();
+static void modbus_poller_transaction_done(MModBus_Transaction_t* transaction);
+
+void modbus_poller_init()
+{
+    // the uart and mmodbus itself are set up by the meter driver, the poller shares that bus
+    sched_register_task(&modbus_poller_submit_request);
+}
+
+/**
+ * @brief Get the number of registers a single value of a poll type takes
+ */
+uint8_t modbus_poller_type_width(uint8_t type)
+{
+    return (type >= MODBUS_POLL_TYPE_UINT32) ? 2 : 1;
+}
+
+static bool modbus_poller_compile(uint16_t max_gap)
+{
+    modbus_range_t ranges[MODBUS_PLANNER_MAX_RANGES];
+    uint8_t range_entry[MODBUS_PLANNER_MAX_RANGES];
+    bool range_is_scale[MODBUS_PLANNER_MAX_RANGES];
+    uint8_t range_count;
+    modbus_plan_t plan;
+    uint8_t value_count = 0;
+
+    for (uint8_t i = 0; i < poller_entry_count; i++) {
+        if ((poller_entries[i].type >= MODBUS_POLL_TYPE_COUNT) || (poller_entries[i].count == 0))
+            return false;
+        poller_value_index[i] = value_count;
+        value_count += poller_entries[i].count;
+        if (value_count > MODBUS_POLLER_MAX_VALUES)
+            return false;
+    }
+
+    poller_read_count = 0;
+    for (uint8_t first = 0; first < poller_entry_count; first++) {
+        uint8_t slave = poller_entries[first].slave;
+        bool planned = false;
+
+        // every slave gets planned once, starting from its first entry
+        for (uint8_t i = 0; i < first; i++)
+            planned |= (poller_entries[i].slave == slave);
+        if (planned)
+            continue;
+
+        range_count = 0;
+        for (uint8_t i = first; i < poller_entry_count; i++) {
+            if (poller_entries[i].slave != slave)
+                continue;
+            ranges[range_count] = (modbus_range_t) { poller_entries[i].start_register,
+                poller_entries[i].count * modbus_poller_type_width(poller_entries[i].type) };
+            range_entry[range_count] = i;
+            range_is_scale[range_count++] = false;
+            if (poller_entries[i].scale_register != MODBUS_POLLER_NO_SCALE_REGISTER) {
+                ranges[range_count] = (modbus_range_t) { poller_entries[i].scale_register, 1 };
+                range_entry[range_count] = i;
+                range_is_scale[range_count++] = true;
+            }
+        }
+
+        if (!modbus_planner_plan(ranges, range_count, max_gap, &plan))
+            return false;
+
+        for (uint8_t r = 0; r < range_count; r++) {
+            uint8_t read = poller_read_count + plan.range_read[r];
+            uint16_t offset = modbus_planner_range_offset(&plan, ranges, r);
+            if (range_is_scale[r]) {
+                poller_scale_read[range_entry[r]] = read;
+                poller_scale_offset[range_entry[r]] = offset;
+            } else {
+                poller_value_read[range_entry[r]] = read;
+                poller_value_offset[range_entry[r]] = offset;
+            }
+        }
+        for (uint8_t r = 0; r < plan.read_count; r++) {
+            poller_reads[poller_read_count] = plan.reads[r];
+            poller_read_slave[poller_read_count++] = slave;
+        }
+    }
+
+    DPRINT("poll list of %d entries compiled into %d reads", poller_entry_count, poller_read_count);
+    return true;
+}
+
+/**
+ * @brief Compile a poll list into the schedule of reads that gets executed on every poll
+ * The blocks and scale factors of every slave are merged into as few reads as the planner allows
+ * @param entries the poll list, has to stay valid until it gets replaced
+ * @param entry_count number of entries, at most MODBUS_POLLER_MAX_ENTRIES
+ * @return false if a poll is still running or the poll list can not be read out
+ */
+bool modbus_poller_plan(const modbus_poll_entry_t* entries, uint8_t entry_count)
+{
+    if (poller_busy || (entry_count > MODBUS_POLLER_MAX_ENTRIES))
+        return false;
+    poller_entries = entries;
+    poller_entry_count = entry_count;
+    poller_replan = false;
+    if (modbus_poller_compile(MODBUS_POLLER_MAX_GAP))
+        return true;
+    poller_entry_count = 0;
+    poller_read_count = 0;
+    return false;
+}
+
+bool modbus_poller_is_busy()
+{
+    return poller_busy;
+}
+
+static void modbus_poller_decode_read(MModBus_Transaction_t* transaction)
+{
+    uint16_t data16[MODBUS_POLLER_MAX_VALUES];
+    uint32_t data32[MODBUS_POLLER_MAX_VALUES];
+    uint16_t raw_scale;
+
+    for (uint8_t i = 0; i < poller_entry_count; i++) {
+        const modbus_poll_entry_t* entry = &poller_entries[i];
+        int64_t* values = &poller_values[poller_value_index[i]];
+
+        if (poller_value_read[i] == poller_read) {
+            if (modbus_poller_type_width(entry->type) == 1)
+                mmodbus_getRegisterRange16i(transaction, poller_value_offset[i], entry->count, data16);
+            else
+                mmodbus_getRegisterRange32i(transaction, poller_value_offset[i], entry->count, data32);
+            for (uint8_t v = 0; v < entry->count; v++) {
+                switch (entry->type) {
+                case MODBUS_POLL_TYPE_UINT16:
+                    values[v] = data16[v];
+                    break;
+                case MODBUS_POLL_TYPE_INT16:
+                    values[v] = (int16_t)data16[v];
+                    break;
+                case MODBUS_POLL_TYPE_UINT32:
+                    values[v] = data32[v];
+                    break;
+                default:
+                    values[v] = (int32_t)data32[v];
+                    break;
+                }
+            }
+        }
+        if ((entry->scale_register != MODBUS_POLLER_NO_SCALE_REGISTER) && (poller_scale_read[i] == poller_read)) {
+            mmodbus_getRegisterRange16i(transaction, poller_scale_offset[i], 1, &raw_scale);
+            poller_scale[i] = (int16_t)raw_scale;
+        }
+    }
+}
+
+static void modbus_poller_finish()
+{
+    bool success = true;
+
+    *poller_valid_entries = 0;
+    for (uint8_t i = 0; i < poller_entry_count; i++) {
+        const modbus_poll_entry_t* entry = &poller_entries[i];
+        bool has_scale = (entry->scale_register != MODBUS_POLLER_NO_SCALE_REGISTER);
+        int16_t scale = has_scale ? poller_scale[i] : 0;
+
+        if ((poller_failed_reads & (1 << poller_value_read[i]))
+            || (has_scale && (poller_failed_reads & (1 << poller_scale_read[i])))) {
+            success = false;
+            continue;
+        }
+        for (uint8_t v = 0; v < entry->count; v++)
+            poller_values[poller_value_index[i] + v]
+                = modbus_planner_scale(poller_values[poller_value_index[i] + v], scale + entry->exponent);
+        *poller_valid_entries |= 1 << i;
+    }
+
+    poller_busy = false;
+    if (poller_replan) {
+        // a slave refused to read through the registers in between, read every block separately from now on
+        log_print_error_string("merged poll read refused, reading every block separately");
+        poller_replan = false;
+        modbus_poller_compile(0);
+    }
+    if (poller_callback)
+        poller_callback(success);
+}
+
+static void modbus_poller_read_next()
+{
+    const modbus_range_t* read = &poller_reads[poller_read];
+    mmodbus_prepareRead(&poller_transaction, poller_read_slave[poller_read], MModbusCMD_ReadHoldingRegisters, read->start, read->length);
+    poller_transaction.callback = &modbus_poller_transaction_done;
+    retry_counter = 0;
+    sched_post_task(&modbus_poller_submit_request);
+}
+
+static void modbus_poller_transaction_done(MModBus_Transaction_t* transaction)
+{
+    retry_counter++;
+    if (transaction->success)
+        modbus_poller_decode_read(transaction);
+    else if (mmodbus_isPermanentError(transaction)) {
+        // asking again gives the same exception, the blocks of this read stay invalid for this cycle
+        log_print_error_string("slave %d rejected register %d, exception %d", poller_read_slave[poller_read],
+            poller_reads[poller_read].start, transaction->exception);
+        poller_failed_reads |= 1 << poller_read;
+        poller_replan = true;
+    } else if (retry_counter <= MODBUS_POLLER_MAX_RETRIES) {
+        timer_post_task_delay(&modbus_poller_submit_request, MODBUS_POLLER_RETRY_DELAY);
+        return;
+    } else
+        poller_failed_reads |= 1 << poller_read;
+
+    poller_read++;
+    if (poller_read < poller_read_count)
+        modbus_poller_read_next();
+    else
+        modbus_poller_finish();
+}
+
+static void modbus_poller_submit_request()
+{
+    // the queue of the bus is full, try again a bit later
+    if (!modbus_bus_submit(&poller_transaction, MODBUS_BUS_PRIORITY_POLL, MODBUS_BUS_NO_DEADLINE))
+        timer_post_task_delay(&modbus_poller_submit_request, MODBUS_POLLER_RETRY_DELAY);
+}
+
+/**
+ * @brief Read out every entry of the poll list in the background
+ * @param values receives the converted values of all entries one after the other, at least MODBUS_POLLER_MAX_VALUES
+ * @param valid_entries receives a bit per entry that got read out successfully
+ * @param callback called once all reads are done
+ * @return false if a previous poll is still running or the poll list is empty
+ */
+bool modbus_poller_poll(int64_t* values, uint8_t* valid_entries, modbus_poller_callback_t callback)
+{
+    if (poller_busy || (poller_read_count == 0))
+        return false;
+    poller_values = values;
+    poller_valid_entries = valid_entries;
+    poller_callback = callback;
+    poller_failed_reads = 0;
+    poller_read = 0;
+    poller_busy = true;
+    modbus_poller_read_next();
+    return true;
+}
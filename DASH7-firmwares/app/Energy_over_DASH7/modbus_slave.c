@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdlib.h>
+#include "modbus_slave.h"
+#include "mmodbus.h"
+#include "timer.h"
+#include "log.h"
+
+#define MODBUS_SLAVE_MAX_READ 125 // registers in a single answer, the most an RTU frame holds
+#define MODBUS_SLAVE_NEVER_REFRESHED 0xFFFF
+
+#ifdef true
+#define DPRINT(...) log_print_string(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+static uint16_t slave_image[MODBUS_SLAVE_REGISTER_COUNT];
+static uint8_t slave_address;
+static bool slave_refreshed;
+static timer_tick_t slave_refresh_time;
+// address, function code, byte count, registers and CRC
+static uint8_t slave_response[5 + 2 * MODBUS_SLAVE_MAX_READ];
+
+void modbus_slave_init()
+{
+    slave_image[MODBUS_SLAVE_AGE_REGISTER] = MODBUS_SLAVE_NEVER_REFRESHED;
+}
+
+static uint16_t modbus_slave_age()
+{
+    uint32_t age;
+
+    if (!slave_refreshed)
+        return MODBUS_SLAVE_NEVER_REFRESHED;
+    age = (timer_get_counter_value() - slave_refresh_time) / TIMER_TICKS_PER_SEC;
+    return (age < MODBUS_SLAVE_NEVER_REFRESHED) ? age : MODBUS_SLAVE_NEVER_REFRESHED - 1;
+}
+
+static void modbus_slave_send(uint16_t length)
+{
+    uint16_t crc = mmodbus_crc16(slave_response, length);
+    slave_response[length++] = crc & 0xFF;
+    slave_response[length++] = crc >> 8;
+    mmodbus_reply(slave_response, length);
+}
+
+static void modbus_slave_exception(uint8_t function, uint8_t exception)
+{
+    slave_response[1] = function | 0x80;
+    slave_response[2] = exception;
+    modbus_slave_send(3);
+}
+
+static void modbus_slave_request(const uint8_t* frame, uint16_t length)
+{
+    uint16_t first, count;
+
+    // broadcasts are never answered and reads make no sense as one
+    if (frame[0] != slave_address)
+        return;
+    slave_response[0] = slave_address;
+    if ((frame[1] != MModbusCMD_ReadHoldingRegisters) && (frame[1] != MModbusCMD_ReadInputRegisters)) {
+        modbus_slave_exception(frame[1], MModBus_Exception_IllegalFunction);
+        return;
+    }
+    if (length != 6)
+        return;
+    first = (frame[2] << 8) | frame[3];
+    count = (frame[4] << 8) | frame[5];
+    if ((count == 0) || (count > MODBUS_SLAVE_MAX_READ)) {
+        modbus_slave_exception(frame[1], MModBus_Exception_IllegalDataValue);
+        return;
+    }
+    if ((first >= MODBUS_SLAVE_REGISTER_COUNT) || (count > MODBUS_SLAVE_REGISTER_COUNT - first)) {
+        modbus_slave_exception(frame[1], MModBus_Exception_IllegalDataAddress);
+        return;
+    }
+
+    // holding and input registers both map onto the same image
+    slave_image[MODBUS_SLAVE_AGE_REGISTER] = modbus_slave_age();
+    slave_response[1] = frame[1];
+    slave_response[2] = 2 * count;
+    for (uint16_t i = 0; i < count; i++) {
+        slave_response[3 + 2 * i] = slave_image[first + i] >> 8;
+        slave_response[4 + 2 * i] = slave_image[first + i] & 0xFF;
+    }
+    modbus_slave_send(3 + 2 * count);
+}
+
+/**
+ * @brief Answer the requests of a local master on a second slave address of the meter bus
+ * The requests only get served in between the transactions towards the meters, a local master has to retry
+ * a request that stays unanswered.
+ * @param address the slave address to answer on, at most 247, 0 to stop answering
+ * @return false if the address is not a valid slave address, the slave then stops answering
+ */
+bool modbus_slave_set_address(uint8_t address)
+{
+    bool valid = (address <= 247);
+
+    if (!valid) {
+        log_print_error_string("modbus slave address %d out of range", address);
+        address = 0;
+    }
+    if (address != slave_address) {
+        slave_address = address;
+        mmodbus_setRequestHandler(address ? &modbus_slave_request : NULL);
+        DPRINT("modbus slave on address %d", address);
+    }
+    return valid;
+}
+
+/**
+ * @brief Copy registers into the image, the age register gets filled in on every request
+ */
+void modbus_slave_write_registers(uint16_t first_register, const uint16_t* registers, uint16_t count)
+{
+    for (uint16_t i = 0; (i < count) && (first_register + i < MODBUS_SLAVE_REGISTER_COUNT); i++)
+        if (first_register + i != MODBUS_SLAVE_AGE_REGISTER)
+            slave_image[first_register + i] = registers[i];
+}
+
+/**
+ * @brief Mark the image as fresh, the age register counts from now on
+ */
+void modbus_slave_refreshed()
+{
+    slave_refreshed = true;
+    slave_refresh_time = timer_get_counter_value();
+}
@@ -59,6 +59,15 @@ static const uart_port_t uart_ports[UART_COUNT] = {
   }
 };
 
+// DMA1 channels routed to USART1 (request 3), the modbus driver moves its frames through these
+#define UART0_DMA_TX_CHANNEL LL_DMA_CHANNEL_4
+#define UART0_DMA_RX_CHANNEL LL_DMA_CHANNEL_5
+#define UART0_DMA_REQUEST LL_DMA_REQUEST_3
+#define UART0_DMA_IRQn DMA1_Channel4_5_6_7_IRQn
+#define UART0_DMA_IRQHandler DMA1_Channel4_5_6_7_IRQHandler
 
+// the RS485 transceiver switches direction by itself: its RE/DE follows RS485_TX through an inverter, so no DE pin
+// is defined here. PA12 is USB D+ on this board. A board that routes the USART1 DE output defines UART0_DE_PIN,
+// UART0_DE_ALTERNATE and UART0_DE_ASSERTION_TIME/UART0_DE_DEASSERTION_TIME (in 1/16 bit, at most 31) instead
 
 #endif
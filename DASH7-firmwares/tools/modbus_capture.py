@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+#
+# This file is part of Sub-IoT.
+# See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Decodes the modbus trace the firmware streams over RTT channel 1 when built with _MMODBUS_CAPTURE.
+# Record it with for example: JLinkRTTLogger -Device STM32L072CZ -If SWD -Speed 4000 -RttChannel 1 capture.bin
+
+import argparse
+import struct
+import sys
+
+RECORD = struct.Struct("<BIB")
+
+TX_BYTE = 1
+RX_BYTE = 2
+TX_START = 3
+TX_END = 4
+RESPONSE_END = 5
+REQUEST_END = 6
+LOST = 7
+
+STATUS = {
+  0: "ok",
+  1: "timeout",
+  2: "send error",
+  3: "crc error",
+  4: "wrong slave",
+  5: "wrong function",
+  6: "invalid response",
+  7: "exception",
+}
+
+PCAP_LINKTYPE_USER0 = 147
+
+
+class Frame():
+
+  def __init__(self, direction, start):
+    self.direction = direction
+    self.start = start
+    self.end = start
+    self.data = bytearray()
+    self.stamps = []
+    self.note = ""
+
+  def add(self, value, timestamp):
+    self.data.append(value)
+    self.stamps.append(timestamp)
+    self.end = timestamp
+
+  def max_gap(self):
+    gaps = [b - a for a, b in zip(self.stamps, self.stamps[1:])]
+    return max(gaps) if gaps else 0
+
+
+def read_records(stream):
+  # the timestamps are 32 bit us since boot, unwrap them every 71 minutes
+  offset = 0
+  previous = None
+  while True:
+    raw = stream.read(RECORD.size)
+    if len(raw) < RECORD.size:
+      return
+    type, timestamp, value = RECORD.unpack(raw)
+    if previous is not None and timestamp < previous and previous - timestamp > 0x80000000:
+      offset += 1 << 32
+    previous = timestamp
+    yield type, timestamp + offset, value
+
+
+def decode(records):
+  frames = []
+  tx = None
+  rx = None
+  lost = 0
+
+  def close_rx(note):
+    nonlocal rx
+    if rx is not None:
+      rx.note = note
+      frames.append(rx)
+      rx = None
+
+  for type, timestamp, value in records:
+    if type == TX_START:
+      close_rx("unexpected")
+      tx = Frame("tx", timestamp)
+    elif type == TX_BYTE and tx is not None:
+      tx.add(value, timestamp)
+    elif type == TX_END and tx is not None:
+      tx.end = timestamp
+      frames.append(tx)
+      tx = None
+    elif type == RX_BYTE:
+      if rx is None:
+        rx = Frame("rx", timestamp)
+      rx.add(value, timestamp)
+    elif type == RESPONSE_END:
+      if rx is None:
+        rx = Frame("rx", timestamp)
+      rx.end = timestamp
+      close_rx(STATUS.get(value, "status %d" % value))
+    elif type == REQUEST_END:
+      close_rx("local request")
+    elif type == LOST:
+      lost += value
+  close_rx("incomplete")
+  return frames, lost
+
+
+def char_time(baudrate):
+  # start bit, 8 data bits and a stop bit
+  return 10 * 1000000 / baudrate if baudrate else None
+
+
+def write_timeline(frames, lost, baudrate, out):
+  character = char_time(baudrate)
+  last_tx_end = None
+  for frame in frames:
+    line = "%12.6f %s %3d bytes" % (frame.start / 1e6, frame.direction, len(frame.data))
+    if frame.direction == "tx":
+      last_tx_end = frame.end
+    elif last_tx_end is not None:
+      # the first byte is stamped once its stop bit is in, its start bit came a character earlier
+      turnaround = frame.start - last_tx_end - (character or 0)
+      line += "  turnaround %8.3f ms" % (turnaround / 1000)
+      last_tx_end = None
+    gap = frame.max_gap()
+    if character:
+      line += "  max gap %5.2f chars" % (gap / character)
+    else:
+      line += "  max gap %7d us" % gap
+    if frame.note:
+      line += "  [%s]" % frame.note
+    out.write(line + "\n")
+    out.write("             " + frame.data.hex(" ") + "\n")
+  if lost:
+    out.write("%d records got lost, read out the RTT channel faster\n" % lost)
+
+
+def write_pcap(frames, path):
+  # raw RTU frames, let wireshark decode user DLT 0 as mbrtu
+  with open(path, "wb") as pcap:
+    pcap.write(struct.pack("<IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 65535, PCAP_LINKTYPE_USER0))
+    for frame in frames:
+      if not frame.data:
+        continue
+      pcap.write(struct.pack("<IIII", frame.start // 1000000, frame.start % 1000000, len(frame.data), len(frame.data)))
+      pcap.write(bytes(frame.data))
+
+
+def main():
+  argparser = argparse.ArgumentParser(description="decode a modbus capture recorded from RTT channel 1")
+  argparser.add_argument("capture", help="binary file recorded from the RTT channel")
+  argparser.add_argument("-b", "--baudrate", help="baud rate of the bus, shows gaps in characters", type=int, default=0)
+  argparser.add_argument("-p", "--pcap", help="also write the frames to this pcap file", default="")
+  args = argparser.parse_args()
+
+  with open(args.capture, "rb") as capture:
+    frames, lost = decode(read_records(capture))
+  write_timeline(frames, lost, args.baudrate, sys.stdout)
+  if args.pcap:
+    write_pcap(frames, args.pcap)
+
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Runs the AcuRev driver and the modbus stack of the firmware, unchanged, against a simulated meter or a replayed
+ * bus session, and checks the values it reads out
+ *
+ * @author contact@liquibit.be
+ */
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AcuRev_1312_RCT.h"
+#include "mmodbus.h"
+#include "acurev_slave.h"
+#include "replay_slave.h"
+#include "sim_platform.h"
+
+#define SIM_DEFAULT_BAUDRATE 19200
+#define SIM_CYCLE_TIMEOUT (60 * 1000000ULL) // us of virtual time a cycle may take with all its retries
+
+static bool cycle_done;
+static bool cycle_success;
+static uint32_t negotiated_baudrate;
+
+static bool sim_cycle_done()
+{
+    return cycle_done;
+}
+
+static void sim_values_read(bool success)
+{
+    cycle_success = success;
+    cycle_done = true;
+}
+
+static void sim_baudrate_found(uint32_t baudrate)
+{
+    negotiated_baudrate = baudrate;
+    cycle_done = true;
+}
+
+static bool sim_values_match(const acurev_values_t* values, const acurev_values_t* expected)
+{
+    return memcmp(values, expected, sizeof(*values)) == 0;
+}
+
+static void sim_print_values(const acurev_values_t* values)
+{
+    for (uint8_t i = 0; i < 3; i++)
+        printf("    phase %c: real %" PRId64 " apparent %" PRId64 " voltage %d current %d\n", 'A' + i,
+            values->real_energy[i], values->apparent_energy[i], values->voltage[i], values->current[i]);
+}
+
+static void sim_print_statistics()
+{
+    MModBus_Statistics_t stats;
+
+    mmodbus_getStatistics(&stats);
+    printf("requests %u, ok %u, timeouts %u, crc errors %u, exceptions %u, recovered %u, noise bytes %u\n",
+        stats.requests, stats.successes, stats.timeouts, stats.crcErrors, stats.exceptions, stats.recovered,
+        stats.discarded);
+    for (uint8_t i = 0; i < _MMODBUS_STATS_FUNCTIONS; i++) {
+        if (stats.latency[i].function == 0)
+            continue;
+        printf("function %u latency buckets:", stats.latency[i].function);
+        for (uint8_t b = 0; b < _MMODBUS_LATENCY_BUCKETS; b++)
+            printf(" %u", stats.latency[i].buckets[b]);
+        printf("\n");
+    }
+}
+
+static void sim_usage(const char* name)
+{
+    printf("usage: %s [options]\n"
+           "  -a, --address N     slave address of the meter (1)\n"
+           "  -b, --baudrate N    rate the meter talks at, gets detected like at boot (19200)\n"
+           "  -l, --latency MS    time the meter takes to answer (20)\n"
+           "  -j, --jitter MS     up to this much gets added to every answer (0)\n"
+           "  -g, --gap US        silence between the characters of an answer (0)\n"
+           "  -n, --noise N       permille of answers with noise in front (0)\n"
+           "  -d, --drop N        permille of answer bytes that get lost (0)\n"
+           "  -c, --corrupt N     permille of answer bytes with a flipped bit (0)\n"
+           "  -C, --clean N       only flip bits on rates above this one (0, every rate)\n"
+           "  -m, --max-baudrate N  move the meter up to this rate after finding it, like a single meter at boot (0)\n"
+           "  -s, --strict        refuse reads through unused registers, like some firmware versions\n"
+           "  -S, --seed N        seed of the impairments, the same seed gives the same session (1)\n"
+           "  -N, --cycles N      measurement cycles to run (10)\n"
+           "  -r, --replay FILE   answer from a capture recorded over RTT instead of the simulated meter\n"
+           "  -v, --verbose       print the log of the firmware\n",
+        name);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = { { "address", required_argument, NULL, 'a' },
+        { "baudrate", required_argument, NULL, 'b' }, { "latency", required_argument, NULL, 'l' },
+        { "jitter", required_argument, NULL, 'j' }, { "gap", required_argument, NULL, 'g' },
+        { "noise", required_argument, NULL, 'n' }, { "drop", required_argument, NULL, 'd' },
+        { "corrupt", required_argument, NULL, 'c' }, { "clean", required_argument, NULL, 'C' },
+        { "max-baudrate", required_argument, NULL, 'm' }, { "strict", no_argument, NULL, 's' },
+        { "seed", required_argument, NULL, 'S' }, { "cycles", required_argument, NULL, 'N' },
+        { "replay", required_argument, NULL, 'r' }, { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' }, { NULL, 0, NULL, 0 } };
+    acurev_slave_config_t meter = { .address = 1, .baudrate = SIM_DEFAULT_BAUDRATE, .latency = 20000, .seed = 1 };
+    const char* replay = NULL;
+    uint32_t cycles = 10;
+    uint32_t ceiling = 0;
+    uint32_t failed = 0;
+    acurev_values_t values;
+    acurev_values_t expected;
+    int option;
+
+    // keep the results in line with the errors of the firmware on stderr when piped
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    while ((option = getopt_long(argc, argv, "a:b:l:j:g:n:d:c:C:m:sS:N:r:vh", options, NULL)) != -1) {
+        switch (option) {
+        case 'a': meter.address = atoi(optarg); break;
+        case 'b': meter.baudrate = atoi(optarg); break;
+        case 'l': meter.latency = atoi(optarg) * 1000; break;
+        case 'j': meter.jitter = atoi(optarg) * 1000; break;
+        case 'g': meter.gap = atoi(optarg); break;
+        case 'n': meter.noise = atoi(optarg); break;
+        case 'd': meter.drop = atoi(optarg); break;
+        case 'c': meter.corrupt = atoi(optarg); break;
+        case 's': meter.strict_map = true; break;
+        case 'C': meter.clean_baudrate = atoi(optarg); break;
+        case 'm': ceiling = atoi(optarg); break;
+        case 'S': meter.seed = strtoul(optarg, NULL, 0); break;
+        case 'N': cycles = atoi(optarg); break;
+        case 'r': replay = optarg; break;
+        case 'v': sim_set_verbose(true); break;
+        default: sim_usage(argv[0]); return (option == 'h') ? 0 : 2;
+        }
+    }
+
+    if (replay != NULL) {
+        if (!replay_slave_init(replay, meter.baudrate)) {
+            fprintf(stderr, "no requests found in %s\n", replay);
+            return 2;
+        }
+        printf("replaying %u exchanges from %s\n", replay_slave_exchanges(), replay);
+    } else
+        acurev_slave_init(&meter);
+    acurev_slave_expected(&expected);
+
+    acurev_1312_rct_init();
+    if ((meter.baudrate != SIM_DEFAULT_BAUDRATE) || (ceiling != 0)) {
+        cycle_done = false;
+        acurev_negotiate_baudrate(meter.address, SIM_DEFAULT_BAUDRATE, ceiling, &sim_baudrate_found);
+        sim_run(&sim_cycle_done, SIM_CYCLE_TIMEOUT);
+        if (negotiated_baudrate == 0) {
+            printf("%10.3f ms  meter not found\n", sim_now() / 1000.0);
+            failed++;
+        } else if ((replay == NULL) && (negotiated_baudrate != acurev_slave_baudrate())) {
+            printf("%10.3f ms  firmware at %u baud, meter at %u baud\n", sim_now() / 1000.0, negotiated_baudrate,
+                acurev_slave_baudrate());
+            failed++;
+        } else
+            printf("%10.3f ms  meter talks at %u baud\n", sim_now() / 1000.0, negotiated_baudrate);
+    }
+
+    for (uint32_t cycle = 0; cycle < cycles; cycle++) {
+        uint64_t start = sim_now();
+        uint64_t awake = sim_awake();
+        bool match;
+
+        memset(&values, 0, sizeof(values));
+        cycle_done = false;
+        cycle_success = false;
+        acurev_get_values(meter.address, &values, &sim_values_read);
+        if (!sim_run(&sim_cycle_done, SIM_CYCLE_TIMEOUT))
+            printf("cycle %u did not finish\n", cycle);
+        match = (replay != NULL) || sim_values_match(&values, &expected);
+        printf("%10.3f ms  cycle %u %s in %.3f ms, %.3f ms awake%s\n", sim_now() / 1000.0, cycle,
+            cycle_success ? "read" : "failed", (sim_now() - start) / 1000.0, (sim_awake() - awake) / 1000.0,
+            (cycle_success && !match) ? ", wrong values" : "");
+        if (cycle_success && (!match || (replay != NULL)))
+            sim_print_values(&values);
+        failed += !cycle_success || !match;
+    }
+
+    sim_print_statistics();
+    if (replay != NULL) {
+        // the firmware asked something the meter never got asked in the recording, its requests changed
+        printf("%u requests had no recorded answer\n", replay_slave_unmatched());
+        failed += replay_slave_unmatched();
+    } else
+        printf("the meter got %u requests\n", acurev_slave_requests());
+    return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <string.h>
+#include "acurev_slave.h"
+#include "sim_frame.h"
+#include "sim_platform.h"
+
+#define ACUREV_SLAVE_MAX_READ 125
+#define ACUREV_SLAVE_MAP_FIRST 4160
+#define ACUREV_SLAVE_MAP_LAST 4299 // room for a read of 125 registers from 4160
+#define ACUREV_SLAVE_NOISE_BYTES 3
+// the system parameters that can be written: the baud rate, the write permission and the reset registers
+#define ACUREV_SLAVE_SETTINGS_FIRST 512
+#define ACUREV_SLAVE_SETTINGS_LAST 525
+#define ACUREV_SLAVE_BAUDRATE_REGISTER 513
+
+#define EXCEPTION_ILLEGAL_FUNCTION 1
+#define EXCEPTION_ILLEGAL_DATA_ADDRESS 2
+#define EXCEPTION_ILLEGAL_DATA_VALUE 3
+
+// the measured quantities as the manual lists them, 32 bit values high word first
+static const int16_t slave_current[3] = { 1523, 1498, -12 }; // 4168, scale factor 4171
+static const uint16_t slave_voltage[3] = { 2301, 2298, 2310 }; // 4173, scale factor 4180
+static const int32_t slave_real_energy[3] = { 1234567, 2345678, 98765 }; // 4213, scale factor 4219
+static const int32_t slave_apparent_energy[3] = { 1334567, 2445678, 108765 }; // 4230, scale factor 4236
+static const int16_t slave_current_scale = -3;
+static const int16_t slave_voltage_scale = -1;
+static const int16_t slave_energy_scale = -3;
+
+static acurev_slave_config_t slave_config;
+static sim_frame_receiver_t slave_receiver;
+static uint16_t slave_registers[ACUREV_SLAVE_MAP_LAST - ACUREV_SLAVE_MAP_FIRST + 1];
+static bool slave_mapped[ACUREV_SLAVE_MAP_LAST - ACUREV_SLAVE_MAP_FIRST + 1];
+static uint16_t slave_settings[ACUREV_SLAVE_SETTINGS_LAST - ACUREV_SLAVE_SETTINGS_FIRST + 1];
+static const uint32_t slave_baudrates[] = { 1200, 2400, 4800, 9600, 19200, 38400 };
+static uint32_t slave_random;
+static uint32_t slave_request_count;
+
+static void acurev_slave_set(uint16_t address, uint16_t value)
+{
+    slave_registers[address - ACUREV_SLAVE_MAP_FIRST] = value;
+    slave_mapped[address - ACUREV_SLAVE_MAP_FIRST] = true;
+}
+
+static void acurev_slave_set32(uint16_t address, int32_t value)
+{
+    // the firmware decodes these with MModBus_32bitOrder_CDAB, which takes the first register as the high word
+    acurev_slave_set(address, (uint32_t)value >> 16);
+    acurev_slave_set(address + 1, (uint32_t)value & 0xFFFF);
+}
+
+static uint32_t acurev_slave_random()
+{
+    // xorshift32, the same seed gives the same session
+    slave_random ^= slave_random << 13;
+    slave_random ^= slave_random >> 17;
+    slave_random ^= slave_random << 5;
+    return slave_random;
+}
+
+static bool acurev_slave_chance(uint16_t permille)
+{
+    return (permille > 0) && ((acurev_slave_random() % 1000) < permille);
+}
+
+static void acurev_slave_answer(uint8_t* frame, uint16_t length, uint64_t end)
+{
+    uint32_t character = sim_char_time(slave_config.baudrate);
+    uint16_t crc = sim_frame_crc(frame, length);
+    uint64_t time = end + slave_config.latency;
+
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+    if (slave_config.jitter > 0)
+        time += acurev_slave_random() % slave_config.jitter;
+    if (acurev_slave_chance(slave_config.noise)) {
+        for (uint8_t i = 0; i < 1 + acurev_slave_random() % ACUREV_SLAVE_NOISE_BYTES; i++) {
+            time += character;
+            sim_line_send(acurev_slave_random() & 0xFF, time, slave_config.baudrate);
+        }
+    }
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t byte = frame[i];
+        time += character;
+        if (((slave_config.clean_baudrate == 0) || (slave_config.baudrate > slave_config.clean_baudrate))
+            && acurev_slave_chance(slave_config.corrupt))
+            byte ^= 1 << (acurev_slave_random() % 8);
+        if (!acurev_slave_chance(slave_config.drop))
+            sim_line_send(byte, time, slave_config.baudrate);
+        time += slave_config.gap;
+    }
+}
+
+static void acurev_slave_exception(const uint8_t* request, uint8_t exception, uint64_t end)
+{
+    uint8_t frame[5] = { request[0], request[1] | 0x80, exception };
+    acurev_slave_answer(frame, 3, end);
+}
+
+static bool acurev_slave_readable(uint16_t address)
+{
+    if ((address < ACUREV_SLAVE_MAP_FIRST) || (address > ACUREV_SLAVE_MAP_LAST))
+        return false;
+    return !slave_config.strict_map || slave_mapped[address - ACUREV_SLAVE_MAP_FIRST];
+}
+
+static void acurev_slave_read(const uint8_t* request, uint64_t end)
+{
+    uint8_t frame[3 + 2 * ACUREV_SLAVE_MAX_READ + 2];
+    uint16_t start = (request[2] << 8) | request[3];
+    uint16_t count = (request[4] << 8) | request[5];
+
+    if ((count == 0) || (count > ACUREV_SLAVE_MAX_READ)) {
+        acurev_slave_exception(request, EXCEPTION_ILLEGAL_DATA_VALUE, end);
+        return;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (!acurev_slave_readable(start + i)) {
+            acurev_slave_exception(request, EXCEPTION_ILLEGAL_DATA_ADDRESS, end);
+            return;
+        }
+    }
+    frame[0] = request[0];
+    frame[1] = request[1];
+    frame[2] = count * 2;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t value = slave_registers[start + i - ACUREV_SLAVE_MAP_FIRST];
+        frame[3 + 2 * i] = value >> 8;
+        frame[4 + 2 * i] = value & 0xFF;
+    }
+    acurev_slave_answer(frame, 3 + count * 2, end);
+}
+
+static void acurev_slave_write(const uint8_t* request, uint16_t length, uint64_t end)
+{
+    uint8_t frame[8];
+    uint16_t start = (request[2] << 8) | request[3];
+    uint16_t count = (request[1] == 6) ? 1 : (request[4] << 8) | request[5];
+
+    uint32_t baudrate = slave_config.baudrate;
+
+    if ((start < ACUREV_SLAVE_SETTINGS_FIRST) || (start + count > ACUREV_SLAVE_SETTINGS_LAST + 1)) {
+        acurev_slave_exception(request, EXCEPTION_ILLEGAL_DATA_ADDRESS, end);
+        return;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* value = (request[1] == 6) ? &request[4] : &request[7 + 2 * i];
+        uint16_t data = (value[0] << 8) | value[1];
+        if (start + i == ACUREV_SLAVE_BAUDRATE_REGISTER) {
+            if (data >= sizeof(slave_baudrates) / sizeof(slave_baudrates[0])) {
+                acurev_slave_exception(request, EXCEPTION_ILLEGAL_DATA_VALUE, end);
+                return;
+            }
+            baudrate = slave_baudrates[data];
+        }
+        slave_settings[start + i - ACUREV_SLAVE_SETTINGS_FIRST] = data;
+    }
+    // both write functions echo the first 6 bytes of the request, on the rate the request came in at
+    memcpy(frame, request, 6);
+    acurev_slave_answer(frame, 6, end);
+    slave_config.baudrate = baudrate;
+    slave_receiver.baudrate = baudrate;
+}
+
+static void acurev_slave_request(const uint8_t* request, uint16_t length, uint64_t end)
+{
+    if (request[0] != slave_config.address)
+        return;
+    slave_request_count++;
+    switch (request[1]) {
+    case 3:
+    case 4:
+        acurev_slave_read(request, end);
+        break;
+    case 6:
+    case 16:
+        acurev_slave_write(request, length, end);
+        break;
+    default:
+        acurev_slave_exception(request, EXCEPTION_ILLEGAL_FUNCTION, end);
+        break;
+    }
+}
+
+static void acurev_slave_receive(uint8_t byte, uint64_t time, uint32_t baudrate)
+{
+    sim_frame_receive(&slave_receiver, byte, time, baudrate);
+}
+
+static const sim_device_t acurev_slave_device = { .receive = &acurev_slave_receive };
+
+/**
+ * @brief Fill the register map and connect the meter to the line
+ */
+void acurev_slave_init(const acurev_slave_config_t* config)
+{
+    slave_config = *config;
+    slave_random = config->seed ? config->seed : 1;
+    slave_request_count = 0;
+    slave_receiver = (sim_frame_receiver_t) { .baudrate = config->baudrate, .handler = &acurev_slave_request };
+    memset(slave_mapped, 0, sizeof(slave_mapped));
+    memset(slave_registers, 0, sizeof(slave_registers));
+
+    for (uint8_t i = 0; i < 3; i++) {
+        acurev_slave_set(4168 + i, slave_current[i]);
+        acurev_slave_set(4173 + i, slave_voltage[i]);
+        acurev_slave_set32(4213 + 2 * i, slave_real_energy[i]);
+        acurev_slave_set32(4230 + 2 * i, slave_apparent_energy[i]);
+    }
+    // the line voltages and their average sit between the phase voltages and their scale factor
+    for (uint8_t i = 0; i < 3; i++)
+        acurev_slave_set(4176 + i, slave_voltage[i] * 173 / 100);
+    acurev_slave_set(4179, (slave_voltage[0] + slave_voltage[1] + slave_voltage[2]) / 3);
+    acurev_slave_set(4171, slave_current_scale);
+    acurev_slave_set(4180, slave_voltage_scale);
+    acurev_slave_set(4219, slave_energy_scale);
+    acurev_slave_set(4236, slave_energy_scale);
+    acurev_slave_set32(4211, slave_real_energy[0] + slave_real_energy[1] + slave_real_energy[2]);
+    acurev_slave_set32(4228, slave_apparent_energy[0] + slave_apparent_energy[1] + slave_apparent_energy[2]);
+
+    sim_attach(&acurev_slave_device);
+}
+
+static int64_t acurev_slave_scale(int64_t value, int16_t exponent)
+{
+    for (; exponent > 0; exponent--)
+        value *= 10;
+    for (; exponent < 0; exponent++)
+        value /= 10;
+    return value;
+}
+
+/**
+ * @brief The values a correct driver reads from the map: raw * 10^(scale factor + exponent of the quantity)
+ */
+void acurev_slave_expected(acurev_values_t* values)
+{
+    for (uint8_t i = 0; i < 3; i++) {
+        values->current[i] = acurev_slave_scale(slave_current[i], slave_current_scale + 3);
+        values->voltage[i] = acurev_slave_scale(slave_voltage[i], slave_voltage_scale);
+        values->real_energy[i] = acurev_slave_scale(slave_real_energy[i], slave_energy_scale + 3);
+        values->apparent_energy[i] = acurev_slave_scale(slave_apparent_energy[i], slave_energy_scale + 3);
+    }
+}
+
+uint32_t acurev_slave_baudrate()
+{
+    return slave_config.baudrate;
+}
+
+uint32_t acurev_slave_requests()
+{
+    return slave_request_count;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Simulated AcuRev 1312: the energy, voltage and current registers with their scale factors, exceptions like the
+ * real meter gives them, and a line that can be slow, noisy and lossy
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __ACUREV_SLAVE_H
+#define __ACUREV_SLAVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "AcuRev_1312_RCT.h"
+
+typedef struct {
+    uint8_t address;
+    uint32_t baudrate;
+    uint32_t latency; // us from the end of a request to the start of the answer
+    uint32_t jitter; // up to this many us get added to the latency
+    uint32_t gap; // us of silence in between two characters of an answer
+    uint16_t noise; // permille of answers that get a few bytes of noise in front
+    uint16_t drop; // permille of answer bytes that get lost
+    uint16_t corrupt; // permille of answer bytes with a flipped bit
+    uint32_t clean_baudrate; // the bits only flip on rates above this one, 0 to flip them on every rate
+    bool strict_map; // reads through the unused registers in between the quantities get exception 2
+    uint32_t seed;
+} acurev_slave_config_t;
+
+void acurev_slave_init(const acurev_slave_config_t* config);
+void acurev_slave_expected(acurev_values_t* values);
+uint32_t acurev_slave_requests();
+uint32_t acurev_slave_baudrate();
+
+#endif //__ACUREV_SLAVE_H
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Runs the benchmark workloads of the firmware against the simulated meter on several baud rates and prints a
+ * table of the throughput, latency and awake time they reach. With --kernels it checks the CRC backend it got
+ * built with against a bitwise CRC and the register decoding against the byte swapping it replaced, and times
+ * both on the host instead
+ *
+ * @author contact@liquibit.be
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "AcuRev_1312_RCT.h"
+#include "modbus_bench.h"
+#include "mmodbus.h"
+#include "acurev_slave.h"
+#include "sim_frame.h"
+#include "sim_platform.h"
+#include "timer.h"
+
+#define SIM_DEFAULT_BAUDRATES "9600,19200,38400"
+#define SIM_MAX_BAUDRATES 8
+#define SIM_RUN_TIMEOUT (600 * 1000000ULL) // us of virtual time a workload may take
+#define SIM_KERNEL_ROUNDS 100000 // calls every kernel timing gets averaged over
+#define SIM_KERNEL_FRAMES 1000 // random frames every kernel gets checked on
+
+#if (_MMODBUS_CRC == _MMODBUS_CRC_HW)
+#define SIM_CRC_BACKEND "crc hw"
+#elif (_MMODBUS_CRC == _MMODBUS_CRC_SLICE4)
+#define SIM_CRC_BACKEND "crc slice4"
+#else
+#define SIM_CRC_BACKEND "crc table"
+#endif
+
+// a read request, the answer to 2 registers and the answer to 125 registers
+static const uint16_t sim_crc_sizes[] = { 8, 9, 255 };
+// the payload of an answer to 125 registers, the most one read returns
+#define SIM_DECODE_BYTES 250
+
+typedef struct {
+    const char* name;
+    uint8_t bits;
+    uint8_t order;
+} sim_decode_case_t;
+
+static const sim_decode_case_t sim_decode_cases[] = { { "16 AB", 16, MModBus_16bitOrder_AB },
+    { "16 BA", 16, MModBus_16bitOrder_BA }, { "32 ABCD", 32, MModBus_32bitOrder_ABCD },
+    { "32 DCBA", 32, MModBus_32bitOrder_DCBA }, { "32 BADC", 32, MModBus_32bitOrder_BADC },
+    { "32 CDAB", 32, MModBus_32bitOrder_CDAB } };
+
+static bool run_done;
+static uint32_t negotiated_baudrate;
+static modbus_bench_result_t bench_result;
+
+static bool sim_run_done()
+{
+    return run_done;
+}
+
+static void sim_baudrate_found(uint32_t baudrate)
+{
+    negotiated_baudrate = baudrate;
+    run_done = true;
+}
+
+static void sim_bench_done(const modbus_bench_result_t* result)
+{
+    bench_result = *result;
+    run_done = true;
+}
+
+static double sim_ticks_to_ms(uint32_t ticks)
+{
+    return ticks * 1000.0 / TIMER_TICKS_PER_SEC;
+}
+
+static double sim_host_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void sim_random_bytes(uint8_t* data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+        data[i] = rand() & 0xFF;
+}
+
+static bool sim_check_crc()
+{
+    static const uint8_t check[] = "123456789";
+    uint8_t frame[_MMODBUS_RXSIZE + 3];
+
+    // the catalogued check value of CRC-16/MODBUS, then random frames at every alignment the block loops can see
+    if (mmodbus_crc16(check, 9) != 0x4B37)
+        return false;
+    for (uint16_t i = 0; i < SIM_KERNEL_FRAMES; i++) {
+        uint16_t length = 1 + rand() % _MMODBUS_RXSIZE;
+        uint8_t offset = i % 4;
+
+        sim_random_bytes(frame + offset, length);
+        if (mmodbus_crc16(frame + offset, length) != sim_frame_crc(frame + offset, length))
+            return false;
+    }
+    return true;
+}
+
+// the decoding of the firmware before the kernels per byte order: swap every byte pair, then reorder every value
+static void sim_swap_order16(uint8_t* bytes, uint16_t length, uint8_t order)
+{
+    uint8_t in[2];
+    uint8_t out[2];
+
+    for (uint16_t i = 0; i < length; i++) {
+        memcpy(in, bytes + i * 2, 2);
+        out[0] = (order == MModBus_16bitOrder_AB) ? in[0] : in[1];
+        out[1] = (order == MModBus_16bitOrder_AB) ? in[1] : in[0];
+        memcpy(bytes + i * 2, out, 2);
+    }
+}
+
+static void sim_swap_order32(uint8_t* bytes, uint16_t length, uint8_t order)
+{
+    uint8_t in[4];
+    uint8_t out[4];
+
+    for (uint16_t i = 0; i < length; i++) {
+        memcpy(in, bytes + i * 4, 4);
+        memcpy(out, in, 4);
+        switch (order) {
+        case MModBus_32bitOrder_DCBA:
+            out[0] = in[3];
+            out[1] = in[2];
+            out[2] = in[1];
+            out[3] = in[0];
+            break;
+        case MModBus_32bitOrder_BADC:
+            out[0] = in[1];
+            out[1] = in[0];
+            out[2] = in[3];
+            out[3] = in[2];
+            break;
+        case MModBus_32bitOrder_CDAB:
+            out[0] = in[2];
+            out[1] = in[3];
+            out[2] = in[0];
+            out[3] = in[1];
+            break;
+        default: break;
+        }
+        memcpy(bytes + i * 4, out, 4);
+    }
+}
+
+static void sim_swap_decode(const MModBus_Transaction_t* transaction, const sim_decode_case_t* decode, void* data)
+{
+    mmodbus_getRegisters8i(transaction, data);
+    if (decode->bits == 16)
+        sim_swap_order16(data, transaction->dataLength / 2, decode->order);
+    else
+        sim_swap_order32(data, transaction->dataLength / 4, decode->order);
+}
+
+static bool sim_kernel_decode(
+    const MModBus_Transaction_t* transaction, const sim_decode_case_t* decode, uint16_t first, void* data)
+{
+    if (decode->bits == 16) {
+        mmodbus_set16bitOrder(decode->order);
+        return mmodbus_getRegisterRange16i(transaction, first, transaction->dataLength / 2 - first, data);
+    }
+    mmodbus_set32bitOrder(decode->order);
+    return mmodbus_getRegisterRange32i(transaction, first, (transaction->dataLength / 2 - first) / 2, data);
+}
+
+static bool sim_check_decode(const sim_decode_case_t* decode)
+{
+    uint32_t wire[SIM_DECODE_BYTES / 4 + 1];
+    uint32_t expected[SIM_DECODE_BYTES / 4];
+    uint32_t decoded[SIM_DECODE_BYTES / 4];
+    MModBus_Transaction_t transaction = { .data = (uint8_t*)wire };
+    MModBus_Transaction_t shifted;
+
+    // whole answers of every length, and the 32 bit values that start at an odd register
+    for (uint16_t i = 0; i < SIM_KERNEL_FRAMES; i++) {
+        uint16_t first = i % 2;
+        uint16_t length = ((decode->bits / 8) * (1 + rand() % (SIM_DECODE_BYTES / (decode->bits / 8) - 1)));
+
+        sim_random_bytes((uint8_t*)wire, sizeof(wire));
+        transaction.dataLength = length + first * 2;
+        shifted.data = transaction.data + first * 2;
+        shifted.dataLength = length;
+        sim_swap_decode(&shifted, decode, expected);
+        if (!sim_kernel_decode(&transaction, decode, first, decoded) || (memcmp(decoded, expected, length) != 0))
+            return false;
+    }
+    return true;
+}
+
+static int sim_run_kernels()
+{
+    uint8_t frame[_MMODBUS_RXSIZE];
+    uint32_t wire[SIM_DECODE_BYTES / 4 + 1];
+    uint32_t decoded[SIM_DECODE_BYTES / 4];
+    MModBus_Transaction_t transaction = { .data = (uint8_t*)wire, .dataLength = SIM_DECODE_BYTES };
+    volatile uint16_t sink = 0;
+    int result = 0;
+
+    // sets up the CRC unit of the hw backend
+    mmodbus_init(100);
+    printf("%-14s %-6s %6s %10s %8s\n", "kernel", "check", "bytes", "ns/call", "ns/byte");
+    sim_random_bytes(frame, sizeof(frame));
+    if (!sim_check_crc())
+        result = 1;
+    for (uint8_t s = 0; s < sizeof(sim_crc_sizes) / sizeof(sim_crc_sizes[0]); s++) {
+        double start = sim_host_ns();
+        double ns;
+
+        for (uint32_t round = 0; round < SIM_KERNEL_ROUNDS; round++)
+            sink ^= mmodbus_crc16(frame, sim_crc_sizes[s]);
+        ns = (sim_host_ns() - start) / SIM_KERNEL_ROUNDS;
+        printf("%-14s %-6s %6u %10.1f %8.2f\n", SIM_CRC_BACKEND, result ? "failed" : "ok", sim_crc_sizes[s], ns,
+            ns / sim_crc_sizes[s]);
+    }
+#if (_MMODBUS_CRC == _MMODBUS_CRC_HW)
+    // the host has no CRC unit, what gets timed is the feeding of the words plus the model of the unit
+    printf("crc hw runs on a bit by bit model of the CRC unit, its time says nothing about the target\n");
+#endif
+
+    sim_random_bytes((uint8_t*)wire, sizeof(wire));
+    for (uint8_t d = 0; d < sizeof(sim_decode_cases) / sizeof(sim_decode_cases[0]); d++) {
+        const sim_decode_case_t* decode = &sim_decode_cases[d];
+        bool equal = sim_check_decode(decode);
+        char name[16];
+        double start;
+        double ns;
+
+        start = sim_host_ns();
+        for (uint32_t round = 0; round < SIM_KERNEL_ROUNDS; round++)
+            sim_swap_decode(&transaction, decode, decoded);
+        ns = (sim_host_ns() - start) / SIM_KERNEL_ROUNDS;
+        snprintf(name, sizeof(name), "swap%s", decode->name);
+        printf("%-14s %-6s %6u %10.1f %8.2f\n", name, "", SIM_DECODE_BYTES, ns, ns / SIM_DECODE_BYTES);
+
+        start = sim_host_ns();
+        for (uint32_t round = 0; round < SIM_KERNEL_ROUNDS; round++)
+            sim_kernel_decode(&transaction, decode, 0, decoded);
+        ns = (sim_host_ns() - start) / SIM_KERNEL_ROUNDS;
+        snprintf(name, sizeof(name), "decode%s", decode->name);
+        printf("%-14s %-6s %6u %10.1f %8.2f\n", name, equal ? "ok" : "failed", SIM_DECODE_BYTES, ns,
+            ns / SIM_DECODE_BYTES);
+        if (!equal)
+            result = 1;
+    }
+    return result;
+}
+
+static uint8_t sim_parse_baudrates(char* list, uint32_t* baudrates)
+{
+    uint8_t count = 0;
+
+    for (char* rate = strtok(list, ","); (rate != NULL) && (count < SIM_MAX_BAUDRATES); rate = strtok(NULL, ","))
+        baudrates[count++] = strtoul(rate, NULL, 0);
+    return count;
+}
+
+static void sim_usage(const char* name)
+{
+    printf("usage: %s [options]\n"
+           "  -a, --address N     slave address of the meter (1)\n"
+           "  -b, --baudrates L   comma separated rates to run the workloads on (" SIM_DEFAULT_BAUDRATES ")\n"
+           "  -l, --latency MS    time the meter takes to answer (20)\n"
+           "  -j, --jitter MS     up to this much gets added to every answer (0)\n"
+           "  -c, --corrupt N     permille of answer bytes with a flipped bit (0)\n"
+           "  -S, --seed N        seed of the impairments, the same seed gives the same session (1)\n"
+           "  -N, --samples N     transactions or measurements per workload, at most %d (%d)\n"
+           "  -k, --kernels       check and time the CRC backend of this build and the register decoding on the host instead\n"
+           "  -v, --verbose       print the log of the firmware\n",
+        name, MODBUS_BENCH_MAX_SAMPLES, MODBUS_BENCH_MAX_SAMPLES);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = { { "address", required_argument, NULL, 'a' },
+        { "baudrates", required_argument, NULL, 'b' }, { "latency", required_argument, NULL, 'l' },
+        { "jitter", required_argument, NULL, 'j' }, { "corrupt", required_argument, NULL, 'c' },
+        { "seed", required_argument, NULL, 'S' }, { "samples", required_argument, NULL, 'N' },
+        { "kernels", no_argument, NULL, 'k' }, { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' }, { NULL, 0, NULL, 0 } };
+    acurev_slave_config_t meter = { .address = 1, .latency = 20000, .seed = 1 };
+    char default_baudrates[] = SIM_DEFAULT_BAUDRATES;
+    char* baudrate_list = default_baudrates;
+    uint32_t baudrates[SIM_MAX_BAUDRATES];
+    uint8_t baudrate_count;
+    uint16_t samples = MODBUS_BENCH_MAX_SAMPLES;
+    bool kernels = false;
+    int result = 0;
+    int option;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    while ((option = getopt_long(argc, argv, "a:b:l:j:c:S:N:kvh", options, NULL)) != -1) {
+        switch (option) {
+        case 'a': meter.address = atoi(optarg); break;
+        case 'b': baudrate_list = optarg; break;
+        case 'l': meter.latency = atoi(optarg) * 1000; break;
+        case 'j': meter.jitter = atoi(optarg) * 1000; break;
+        case 'c': meter.corrupt = atoi(optarg); break;
+        case 'S': meter.seed = strtoul(optarg, NULL, 0); break;
+        case 'N': samples = atoi(optarg); break;
+        case 'k': kernels = true; break;
+        case 'v': sim_set_verbose(true); break;
+        default: sim_usage(argv[0]); return (option == 'h') ? 0 : 2;
+        }
+    }
+    if (kernels)
+        return sim_run_kernels();
+    baudrate_count = sim_parse_baudrates(baudrate_list, baudrates);
+    if ((baudrate_count == 0) || (samples == 0) || (samples > MODBUS_BENCH_MAX_SAMPLES)) {
+        sim_usage(argv[0]);
+        return 2;
+    }
+
+    meter.baudrate = baudrates[0];
+    acurev_slave_init(&meter);
+    acurev_1312_rct_init();
+    modbus_bench_init();
+
+    printf("%8s %-9s %7s %6s %9s %9s %8s %8s %10s\n", "baud", "workload", "samples", "failed", "trans/s", "regs/s",
+        "p50 ms", "p99 ms", "awake us");
+    for (uint8_t r = 0; r < baudrate_count; r++) {
+        // the meter moves to the next rate and the firmware finds it there with its first probe
+        meter.baudrate = baudrates[r];
+        acurev_slave_init(&meter);
+        run_done = false;
+        acurev_negotiate_baudrate(meter.address, meter.baudrate, 0, &sim_baudrate_found);
+        sim_run(&sim_run_done, SIM_RUN_TIMEOUT);
+        if (negotiated_baudrate != meter.baudrate) {
+            printf("%8u the firmware did not find the meter\n", meter.baudrate);
+            result = 1;
+            continue;
+        }
+
+        for (uint8_t workload = 0; workload < MODBUS_BENCH_WORKLOAD_COUNT; workload++) {
+            uint64_t start = sim_now();
+            uint64_t awake = sim_awake();
+            double seconds;
+
+            run_done = false;
+            modbus_bench_run(meter.address, workload, samples, &sim_bench_done);
+            sim_run(&sim_run_done, SIM_RUN_TIMEOUT);
+            // virtual time is exact, the awake time includes the scheduler and the interrupts besides mmodbus
+            seconds = (sim_now() - start) / 1e6;
+            printf("%8u %-9s %7u %6u %9.1f %9.1f %8.1f %8.1f %10.0f\n", meter.baudrate,
+                modbus_bench_workload_name(workload), bench_result.samples, bench_result.failures,
+                bench_result.transactions / seconds, bench_result.registers / seconds,
+                sim_ticks_to_ms(bench_result.latency_p50), sim_ticks_to_ms(bench_result.latency_p99),
+                (double)(sim_awake() - awake) / bench_result.samples);
+        }
+    }
+    return result;
+}
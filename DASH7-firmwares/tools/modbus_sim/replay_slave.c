@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdio.h>
+#include <string.h>
+#include "replay_slave.h"
+#include "modbus_capture.h"
+#include "sim_frame.h"
+#include "sim_platform.h"
+
+#define REPLAY_MAX_EXCHANGES 1024
+#define REPLAY_REQUEST_SIZE 64
+
+typedef struct {
+    uint8_t request[REPLAY_REQUEST_SIZE];
+    uint8_t request_length;
+    uint8_t response[SIM_FRAME_SIZE];
+    uint32_t response_offset[SIM_FRAME_SIZE]; // us from the end of the request to the end of every answer byte
+    uint16_t response_length;
+    bool used;
+} replay_exchange_t;
+
+static replay_exchange_t replay_exchanges[REPLAY_MAX_EXCHANGES];
+static uint16_t replay_exchange_count;
+static uint16_t replay_unmatched;
+static sim_frame_receiver_t replay_receiver;
+static uint32_t replay_baudrate;
+
+static bool replay_slave_load(FILE* capture)
+{
+    modbus_capture_record_t record;
+    replay_exchange_t* exchange = NULL;
+    uint32_t request_end = 0;
+    bool answering = false;
+
+    while (fread(&record, sizeof(record), 1, capture) == 1) {
+        switch (record.type) {
+        case MODBUS_CAPTURE_TX_START:
+            if (replay_exchange_count == REPLAY_MAX_EXCHANGES)
+                return true;
+            exchange = &replay_exchanges[replay_exchange_count++];
+            memset(exchange, 0, sizeof(*exchange));
+            answering = false;
+            break;
+        case MODBUS_CAPTURE_TX_BYTE:
+            if ((exchange != NULL) && !answering && (exchange->request_length < REPLAY_REQUEST_SIZE))
+                exchange->request[exchange->request_length++] = record.value;
+            break;
+        case MODBUS_CAPTURE_TX_END:
+            request_end = record.timestamp;
+            answering = true;
+            break;
+        case MODBUS_CAPTURE_RX_BYTE:
+            if ((exchange != NULL) && answering && (exchange->response_length < SIM_FRAME_SIZE)) {
+                // the stamps are 32 bit us, the subtraction survives a wrap in between
+                exchange->response_offset[exchange->response_length] = record.timestamp - request_end;
+                exchange->response[exchange->response_length++] = record.value;
+            }
+            break;
+        case MODBUS_CAPTURE_RESPONSE_END:
+            answering = false;
+            break;
+        default:
+            break;
+        }
+    }
+    return replay_exchange_count > 0;
+}
+
+static void replay_slave_request(const uint8_t* request, uint16_t length, uint64_t end)
+{
+    for (uint16_t i = 0; i < replay_exchange_count; i++) {
+        replay_exchange_t* exchange = &replay_exchanges[i];
+        if (exchange->used || (exchange->request_length != length) || memcmp(exchange->request, request, length))
+            continue;
+        exchange->used = true;
+        for (uint16_t b = 0; b < exchange->response_length; b++)
+            sim_line_send(exchange->response[b], end + exchange->response_offset[b], replay_baudrate);
+        return;
+    }
+    replay_unmatched++;
+}
+
+static void replay_slave_receive(uint8_t byte, uint64_t time, uint32_t baudrate)
+{
+    sim_frame_receive(&replay_receiver, byte, time, baudrate);
+}
+
+static const sim_device_t replay_slave_device = { .receive = &replay_slave_receive };
+
+/**
+ * @brief Load a capture recorded from RTT channel 1 and connect its slaves to the line
+ * Recorded exchanges get answered once each, in the order they were recorded
+ * @param baudrate the rate of the bus during the recording
+ * @return false if the file holds no request
+ */
+bool replay_slave_init(const char* path, uint32_t baudrate)
+{
+    FILE* capture = fopen(path, "rb");
+    bool loaded;
+
+    if (capture == NULL)
+        return false;
+    replay_exchange_count = 0;
+    replay_unmatched = 0;
+    loaded = replay_slave_load(capture);
+    fclose(capture);
+
+    replay_baudrate = baudrate;
+    replay_receiver = (sim_frame_receiver_t) { .baudrate = baudrate, .handler = &replay_slave_request };
+    sim_attach(&replay_slave_device);
+    return loaded;
+}
+
+uint16_t replay_slave_exchanges()
+{
+    return replay_exchange_count;
+}
+
+// requests the recording holds no answer for, they stay unanswered
+uint16_t replay_slave_unmatched()
+{
+    return replay_unmatched;
+}
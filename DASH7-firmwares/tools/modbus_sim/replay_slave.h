@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Plays back a bus session recorded with the modbus capture of the firmware: every request that matches a recorded
+ * one gets the recorded answer, with the recorded turnaround and character timing
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __REPLAY_SLAVE_H
+#define __REPLAY_SLAVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool replay_slave_init(const char* path, uint32_t baudrate);
+uint16_t replay_slave_exchanges();
+uint16_t replay_slave_unmatched();
+
+#endif //__REPLAY_SLAVE_H
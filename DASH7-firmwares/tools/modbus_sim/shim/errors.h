@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Host stand-in of the Sub-IoT error codes
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __ERRORS_H_
+#define __ERRORS_H_
+
+typedef int error_t;
+
+#define SUCCESS 0
+#define FAIL 1
+#define ENOENT 2
+#define ENOMEM 12
+#define EBUSY 16
+#define EINVAL 22
+#define ETIMEDOUT 110
+#define EALREADY 114
+#define ESIZE 200
+#define EOFF 201
+
+#endif
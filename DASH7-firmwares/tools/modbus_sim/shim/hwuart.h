@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Host stand-in of the Sub-IoT uart driver, the simulated line carries the bytes
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __HWUART_H_
+#define __HWUART_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "errors.h"
+
+typedef struct uart_handle uart_handle_t;
+typedef void (*uart_rx_inthandler_t)(uart_handle_t* uart, uint8_t byte);
+
+uart_handle_t* uart_init(uint8_t port_idx, uint32_t baudrate, uint8_t pins);
+bool uart_enable(uart_handle_t* uart);
+bool uart_disable(uart_handle_t* uart);
+error_t uart_rx_interrupt_enable(uart_handle_t* uart);
+void uart_rx_interrupt_disable(uart_handle_t* uart);
+void uart_set_rx_interrupt_callback(uart_handle_t* uart, uart_rx_inthandler_t rx_handler);
+
+#endif
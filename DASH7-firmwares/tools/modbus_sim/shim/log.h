@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Host stand-in of the Sub-IoT log, printed with the virtual time
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __LOG_H_
+#define __LOG_H_
+
+#include <stdint.h>
+
+void log_print_string(char* format, ...);
+void log_print_error_string(char* format, ...);
+void log_print_data(uint8_t* message, uint32_t length);
+
+#endif
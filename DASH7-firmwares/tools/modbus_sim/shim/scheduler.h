@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Host stand-in of the Sub-IoT scheduler, tasks run in the order they got posted
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __SCHEDULER_H_
+#define __SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "errors.h"
+
+typedef void (*task_t)(void* arg);
+
+#define MAX_PRIORITY 0
+#define MIN_PRIORITY 7
+#define DEFAULT_PRIORITY 7
+
+error_t sched_register_task(task_t task);
+error_t sched_post_task_prio(task_t task, uint8_t priority, void* arg);
+#define sched_post_task(task) sched_post_task_prio((task_t)(task), DEFAULT_PRIORITY, NULL)
+bool sched_is_scheduled(task_t task);
+error_t sched_cancel_task(task_t task);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * The registers and LL functions of the STM32L0 that the modbus stack touches, backed by the simulator
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __STM32_DEVICE_H_
+#define __STM32_DEVICE_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t enabled;
+    uint32_t stop_mode;
+    uint32_t baudrate;
+} USART_TypeDef;
+
+extern USART_TypeDef sim_usart1;
+#define USART1 (&sim_usart1)
+
+#define HSI_VALUE 16000000U
+#define LL_USART_OVERSAMPLING_16 0
+
+// the CMSIS intrinsics the register decoding uses
+static inline uint32_t __REV(uint32_t value) { return __builtin_bswap32(value); }
+static inline uint32_t __REV16(uint32_t value)
+{
+    return ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
+}
+static inline uint32_t __ROR(uint32_t value, uint32_t shift)
+{
+    shift %= 32;
+    return shift ? (value >> shift) | (value << (32 - shift)) : value;
+}
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay);
+void __WFI(void);
+
+void LL_USART_Enable(USART_TypeDef* usart);
+void LL_USART_Disable(USART_TypeDef* usart);
+void LL_USART_EnableInStopMode(USART_TypeDef* usart);
+void LL_USART_SetBaudRate(USART_TypeDef* usart, uint32_t clock, uint32_t oversampling, uint32_t baudrate);
+uint32_t LL_USART_GetOverSampling(USART_TypeDef* usart);
+uint32_t LL_USART_IsActiveFlag_TXE(USART_TypeDef* usart);
+uint32_t LL_USART_IsActiveFlag_TC(USART_TypeDef* usart);
+uint32_t LL_USART_IsActiveFlag_RXNE(USART_TypeDef* usart);
+uint32_t LL_USART_IsActiveFlag_ORE(USART_TypeDef* usart);
+void LL_USART_ClearFlag_TC(USART_TypeDef* usart);
+void LL_USART_ClearFlag_ORE(USART_TypeDef* usart);
+void LL_USART_TransmitData8(USART_TypeDef* usart, uint8_t data);
+uint8_t LL_USART_ReceiveData8(USART_TypeDef* usart);
+void LL_USART_EnableIT_RXNE(USART_TypeDef* usart);
+void LL_USART_DisableIT_RXNE(USART_TypeDef* usart);
+
+#endif
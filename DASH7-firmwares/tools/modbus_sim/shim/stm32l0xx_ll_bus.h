@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* \file
+ *
+ * Peripheral clocks of the STM32L0, every simulated peripheral is always clocked
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __STM32L0xx_LL_BUS_H
+#define __STM32L0xx_LL_BUS_H
+
+#include <stdint.h>
+
+#define LL_AHB1_GRP1_PERIPH_CRC 0x00001000U
+
+static inline void LL_AHB1_GRP1_EnableClock(uint32_t periphs) { (void)periphs; }
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* \file
+ *
+ * The CRC unit of the STM32L0, modelled bit by bit as the reference manual describes it: every byte gets
+ * reversed if configured and shifted in from its most significant bit on, a word from its most significant byte on
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __STM32L0xx_LL_CRC_H
+#define __STM32L0xx_LL_CRC_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t state;
+    uint32_t init;
+    uint32_t polynomial;
+    uint32_t size;
+    uint32_t reverse_in;
+    uint32_t reverse_out;
+} CRC_TypeDef;
+
+extern CRC_TypeDef sim_crc;
+#define CRC (&sim_crc)
+
+#define LL_CRC_POLYLENGTH_32B 32U
+#define LL_CRC_POLYLENGTH_16B 16U
+#define LL_CRC_POLYLENGTH_8B 8U
+#define LL_CRC_INDATA_REVERSE_NONE 0U
+#define LL_CRC_INDATA_REVERSE_BYTE 1U
+#define LL_CRC_OUTDATA_REVERSE_NONE 0U
+#define LL_CRC_OUTDATA_REVERSE_BIT 1U
+
+static inline uint32_t sim_crc_reflect(uint32_t value, uint8_t bits)
+{
+    uint32_t reflected = 0;
+
+    for (uint8_t i = 0; i < bits; i++, value >>= 1)
+        reflected = (reflected << 1) | (value & 1);
+    return reflected;
+}
+
+static inline void sim_crc_shift(CRC_TypeDef* crc, uint8_t data)
+{
+    uint32_t top = 1U << (crc->size - 1);
+    uint32_t mask = (crc->size == 32) ? 0xFFFFFFFFU : (1U << crc->size) - 1;
+
+    if (crc->reverse_in == LL_CRC_INDATA_REVERSE_BYTE)
+        data = sim_crc_reflect(data, 8);
+    for (uint8_t i = 0; i < 8; i++, data <<= 1) {
+        uint32_t feedback = ((crc->state & top) != 0) ^ ((data & 0x80) != 0);
+        crc->state = ((crc->state << 1) ^ (feedback ? crc->polynomial : 0)) & mask;
+    }
+}
+
+static inline void LL_CRC_SetPolynomialSize(CRC_TypeDef* crc, uint32_t size) { crc->size = size; }
+static inline void LL_CRC_SetPolynomialCoef(CRC_TypeDef* crc, uint32_t polynomial) { crc->polynomial = polynomial; }
+static inline void LL_CRC_SetInitialData(CRC_TypeDef* crc, uint32_t init) { crc->init = init; }
+static inline void LL_CRC_SetInputDataReverseMode(CRC_TypeDef* crc, uint32_t mode) { crc->reverse_in = mode; }
+static inline void LL_CRC_SetOutputDataReverseMode(CRC_TypeDef* crc, uint32_t mode) { crc->reverse_out = mode; }
+static inline void LL_CRC_ResetCRCCalculationUnit(CRC_TypeDef* crc) { crc->state = crc->init; }
+
+static inline void LL_CRC_FeedData8(CRC_TypeDef* crc, uint8_t data) { sim_crc_shift(crc, data); }
+
+static inline void LL_CRC_FeedData32(CRC_TypeDef* crc, uint32_t data)
+{
+    for (int8_t shift = 24; shift >= 0; shift -= 8)
+        sim_crc_shift(crc, data >> shift);
+}
+
+static inline uint16_t LL_CRC_ReadData16(CRC_TypeDef* crc)
+{
+    return (crc->reverse_out == LL_CRC_OUTDATA_REVERSE_BIT) ? sim_crc_reflect(crc->state, crc->size) : crc->state;
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Clock settings of the STM32L0, the simulated uart always runs
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __STM32L0xx_LL_RCC_H
+#define __STM32L0xx_LL_RCC_H
+
+#include <stdint.h>
+
+#define LL_RCC_USART1_CLKSOURCE_HSI 0
+
+static inline void LL_RCC_HSI_Enable(void) { }
+static inline uint32_t LL_RCC_HSI_IsReady(void) { return 1; }
+static inline void LL_RCC_SetUSARTClockSource(uint32_t source) { (void)source; }
+
+#endif
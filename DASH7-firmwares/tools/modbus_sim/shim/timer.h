@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Host stand-in of the Sub-IoT timer, counting on the virtual clock of the simulator
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __TIMER_H_
+#define __TIMER_H_
+
+#include "scheduler.h"
+
+typedef uint32_t timer_tick_t;
+
+#define TIMER_TICKS_PER_SEC 1024
+
+error_t timer_post_task_delay(task_t task, timer_tick_t delay);
+void timer_cancel_task(task_t task);
+bool timer_is_task_scheduled(task_t task);
+timer_tick_t timer_get_counter_value(void);
+
+#endif
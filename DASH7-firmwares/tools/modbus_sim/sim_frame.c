@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ *
+ * @author contact@liquibit.be
+ */
+#include "sim_frame.h"
+#include "sim_platform.h"
+
+// the length of a request follows from its function code, the multiple writes carry their byte count
+static uint16_t sim_frame_expected_length(const sim_frame_receiver_t* receiver)
+{
+    if (receiver->length < 2)
+        return 0;
+    if ((receiver->data[1] == 15) || (receiver->data[1] == 16))
+        return (receiver->length < 7) ? 0 : 9 + receiver->data[6];
+    return 8;
+}
+
+/**
+ * @brief Add a byte the master sent, the handler gets every complete request with a valid CRC
+ * A silence of 3.5 characters starts a new frame, like on a real slave
+ */
+void sim_frame_receive(sim_frame_receiver_t* receiver, uint8_t byte, uint64_t time, uint32_t baudrate)
+{
+    uint32_t character = sim_char_time(receiver->baudrate);
+    uint16_t expected;
+
+    if (baudrate != receiver->baudrate) {
+        receiver->length = 0;
+        return;
+    }
+    if ((receiver->length > 0) && (time - receiver->last > character + (character * 7) / 2))
+        receiver->length = 0;
+    receiver->last = time;
+    if (receiver->length == SIM_FRAME_SIZE)
+        receiver->length = 0;
+    receiver->data[receiver->length++] = byte;
+
+    expected = sim_frame_expected_length(receiver);
+    if ((expected == 0) || (receiver->length < expected))
+        return;
+    if (sim_frame_crc(receiver->data, receiver->length) == 0)
+        receiver->handler(receiver->data, receiver->length, time);
+    receiver->length = 0;
+}
+
+// CRC-16/MODBUS, bit by bit, appended low byte first, a frame including its CRC gives 0
+uint16_t sim_frame_crc(const uint8_t* data, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Request framing and CRC on the device side of the simulated line, independent of the firmware's own
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __SIM_FRAME_H
+#define __SIM_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_FRAME_SIZE 256
+
+// a complete request with a valid CRC, end is the time its last stop bit passed
+typedef void (*sim_frame_handler_t)(const uint8_t* frame, uint16_t length, uint64_t end);
+
+typedef struct {
+    uint32_t baudrate; // the rate the device listens at, bytes sent at another rate are garbage to it
+    sim_frame_handler_t handler;
+    uint8_t data[SIM_FRAME_SIZE];
+    uint16_t length;
+    uint64_t last;
+} sim_frame_receiver_t;
+
+void sim_frame_receive(sim_frame_receiver_t* receiver, uint8_t byte, uint64_t time, uint32_t baudrate);
+uint16_t sim_frame_crc(const uint8_t* data, uint16_t length);
+
+#endif //__SIM_FRAME_H
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * The scheduler, timer, uart and LL functions the firmware drivers call, running on a virtual clock in us.
+ * Time only passes while the code looks at the clock or polls a uart flag, and while the platform sleeps until
+ * the next timer or received byte. Only that polling and a fixed cost per task and interrupt count as awake.
+ *
+ * @author contact@liquibit.be
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_platform.h"
+#include "hwatomic.h"
+#include "hwsystem.h"
+#include "hwuart.h"
+#include "log.h"
+#include "stm32_device.h"
+#include "stm32l0xx_ll_crc.h"
+#include "timer.h"
+
+#define SIM_MAX_TASKS 64
+#define SIM_LINE_SIZE 1024
+
+struct uart_handle {
+    uint32_t baudrate;
+    bool enabled;
+    bool rx_interrupt;
+    uart_rx_inthandler_t handler;
+};
+
+typedef struct {
+    uint64_t time;
+    uint8_t byte;
+    uint32_t baudrate;
+} sim_line_byte_t;
+
+USART_TypeDef sim_usart1;
+CRC_TypeDef sim_crc;
+
+static uint64_t sim_time;
+static uint64_t sim_awake_time;
+static bool sim_verbose;
+
+static task_t sim_tasks[SIM_MAX_TASKS];
+static uint8_t sim_task_count;
+static bool sim_task_posted[SIM_MAX_TASKS];
+static uint8_t sim_queue[SIM_MAX_TASKS];
+static uint8_t sim_queue_head;
+static uint8_t sim_queue_count;
+static bool sim_timer_armed[SIM_MAX_TASKS];
+static uint64_t sim_timer_due[SIM_MAX_TASKS];
+
+static struct uart_handle sim_uart;
+static uint64_t sim_tx_free;
+static sim_line_byte_t sim_line[SIM_LINE_SIZE];
+static uint16_t sim_line_count;
+static const sim_device_t* sim_device;
+static uint8_t sim_atomic_depth;
+static bool sim_delivering;
+
+static int sim_find_task(task_t task)
+{
+    for (uint8_t i = 0; i < sim_task_count; i++)
+        if (sim_tasks[i] == task)
+            return i;
+    fprintf(stderr, "task %p got used without being registered\n", (void*)task);
+    abort();
+}
+
+// hand the bytes of the device that passed the line to the receive interrupt
+static void sim_deliver()
+{
+    if ((sim_atomic_depth > 0) || sim_delivering)
+        return;
+    sim_delivering = true;
+    while ((sim_line_count > 0) && (sim_line[0].time <= sim_time)) {
+        sim_line_byte_t received = sim_line[0];
+        memmove(&sim_line[0], &sim_line[1], --sim_line_count * sizeof(sim_line[0]));
+        if (!sim_uart.enabled || !sim_uart.rx_interrupt || (sim_uart.handler == NULL))
+            continue;
+        // on another rate the uart samples garbage
+        if (received.baudrate != sim_uart.baudrate)
+            received.byte ^= 0xA5;
+        sim_time += SIM_INTERRUPT_COST_US;
+        sim_awake_time += SIM_INTERRUPT_COST_US;
+        sim_uart.handler(&sim_uart, received.byte);
+    }
+    sim_delivering = false;
+}
+
+static void sim_spend(uint64_t us)
+{
+    sim_time += us;
+    sim_awake_time += us;
+    sim_deliver();
+}
+
+static void sim_post_due_timers()
+{
+    for (uint8_t i = 0; i < sim_task_count; i++) {
+        if (sim_timer_armed[i] && (sim_timer_due[i] <= sim_time)) {
+            sim_timer_armed[i] = false;
+            sched_post_task(sim_tasks[i]);
+        }
+    }
+}
+
+// the time of the next timer or received byte, false when nothing is pending
+static bool sim_next_event(uint64_t* next)
+{
+    bool found = false;
+    for (uint8_t i = 0; i < sim_task_count; i++) {
+        if (sim_timer_armed[i] && (!found || (sim_timer_due[i] < *next))) {
+            *next = sim_timer_due[i];
+            found = true;
+        }
+    }
+    if ((sim_line_count > 0) && (!found || (sim_line[0].time < *next))) {
+        *next = sim_line[0].time;
+        found = true;
+    }
+    return found;
+}
+
+static void sim_sleep_until(uint64_t time)
+{
+    if (time > sim_time)
+        sim_time = time;
+    sim_deliver();
+    sim_post_due_timers();
+}
+
+/**
+ * @brief Run the posted tasks, sleeping in between, until done returns true
+ * @param timeout us of virtual time after which to give up
+ * @return false on a timeout or when nothing is left to run
+ */
+bool sim_run(sim_condition_t done, uint64_t timeout)
+{
+    uint64_t end = sim_time + timeout;
+    uint64_t next = 0;
+
+    while (!done()) {
+        if (sim_time > end)
+            return false;
+        sim_post_due_timers();
+        if (sim_queue_count > 0) {
+            uint8_t index = sim_queue[sim_queue_head];
+            sim_queue_head = (sim_queue_head + 1) % SIM_MAX_TASKS;
+            sim_queue_count--;
+            sim_task_posted[index] = false;
+            sim_spend(SIM_TASK_COST_US);
+            sim_tasks[index](NULL);
+            continue;
+        }
+        if (!sim_next_event(&next))
+            return false;
+        sim_sleep_until(next);
+    }
+    return true;
+}
+
+void sim_attach(const sim_device_t* device)
+{
+    sim_device = device;
+}
+
+/**
+ * @brief Put a byte of the device on the line
+ * @param time when its stop bit passed, the receive interrupt of the uart runs then
+ */
+void sim_line_send(uint8_t byte, uint64_t time, uint32_t baudrate)
+{
+    uint16_t position = sim_line_count;
+
+    if (sim_line_count == SIM_LINE_SIZE)
+        return;
+    while ((position > 0) && (sim_line[position - 1].time > time))
+        position--;
+    memmove(&sim_line[position + 1], &sim_line[position], (sim_line_count - position) * sizeof(sim_line[0]));
+    sim_line[position] = (sim_line_byte_t) { time, byte, baudrate };
+    sim_line_count++;
+}
+
+// start bit, 8 data bits and stop bit
+uint32_t sim_char_time(uint32_t baudrate)
+{
+    return (10 * 1000000 + baudrate - 1) / baudrate;
+}
+
+uint64_t sim_now()
+{
+    return sim_time;
+}
+
+uint64_t sim_awake()
+{
+    return sim_awake_time;
+}
+
+uint32_t sim_uart_baudrate()
+{
+    return sim_uart.baudrate;
+}
+
+void sim_set_verbose(bool verbose)
+{
+    sim_verbose = verbose;
+}
+
+// scheduler
+
+error_t sched_register_task(task_t task)
+{
+    for (uint8_t i = 0; i < sim_task_count; i++)
+        if (sim_tasks[i] == task)
+            return SUCCESS;
+    if (sim_task_count == SIM_MAX_TASKS)
+        return ENOMEM;
+    sim_tasks[sim_task_count++] = task;
+    return SUCCESS;
+}
+
+error_t sched_post_task_prio(task_t task, uint8_t priority, void* arg)
+{
+    int index = sim_find_task(task);
+    if (sim_task_posted[index])
+        return SUCCESS;
+    sim_task_posted[index] = true;
+    sim_queue[(sim_queue_head + sim_queue_count) % SIM_MAX_TASKS] = index;
+    sim_queue_count++;
+    return SUCCESS;
+}
+
+bool sched_is_scheduled(task_t task)
+{
+    return sim_task_posted[sim_find_task(task)];
+}
+
+error_t sched_cancel_task(task_t task)
+{
+    int index = sim_find_task(task);
+    uint8_t kept = 0;
+
+    if (!sim_task_posted[index])
+        return EALREADY;
+    sim_task_posted[index] = false;
+    for (uint8_t i = 0; i < sim_queue_count; i++) {
+        uint8_t queued = sim_queue[(sim_queue_head + i) % SIM_MAX_TASKS];
+        if (queued != index)
+            sim_queue[(sim_queue_head + kept++) % SIM_MAX_TASKS] = queued;
+    }
+    sim_queue_count = kept;
+    return SUCCESS;
+}
+
+// timer
+
+error_t timer_post_task_delay(task_t task, timer_tick_t delay)
+{
+    int index = sim_find_task(task);
+    sim_timer_armed[index] = true;
+    sim_timer_due[index] = sim_time + ((uint64_t)delay * 1000000) / TIMER_TICKS_PER_SEC;
+    return SUCCESS;
+}
+
+void timer_cancel_task(task_t task)
+{
+    sim_timer_armed[sim_find_task(task)] = false;
+}
+
+bool timer_is_task_scheduled(task_t task)
+{
+    return sim_timer_armed[sim_find_task(task)];
+}
+
+timer_tick_t timer_get_counter_value(void)
+{
+    sim_spend(1);
+    return (timer_tick_t)((sim_time * TIMER_TICKS_PER_SEC) / 1000000);
+}
+
+// system
+
+uint32_t HAL_GetTick(void)
+{
+    sim_spend(1);
+    return (uint32_t)(sim_time / 1000);
+}
+
+void HAL_Delay(uint32_t delay)
+{
+    sim_spend((uint64_t)delay * 1000);
+}
+
+void __WFI(void)
+{
+    uint64_t next = 0;
+    sim_post_due_timers();
+    if (sim_next_event(&next))
+        sim_sleep_until(next);
+}
+
+void hw_busy_wait(int16_t microseconds)
+{
+    sim_spend(microseconds);
+}
+
+void hw_reset(void)
+{
+    fprintf(stderr, "the firmware reset the device\n");
+    exit(1);
+}
+
+void start_atomic(void)
+{
+    sim_atomic_depth++;
+}
+
+void end_atomic(void)
+{
+    if (--sim_atomic_depth == 0)
+        sim_deliver();
+}
+
+// uart
+
+uart_handle_t* uart_init(uint8_t port_idx, uint32_t baudrate, uint8_t pins)
+{
+    sim_uart.baudrate = baudrate;
+    return &sim_uart;
+}
+
+bool uart_enable(uart_handle_t* uart)
+{
+    uart->enabled = true;
+    return true;
+}
+
+bool uart_disable(uart_handle_t* uart)
+{
+    uart->enabled = false;
+    return true;
+}
+
+error_t uart_rx_interrupt_enable(uart_handle_t* uart)
+{
+    uart->rx_interrupt = true;
+    return SUCCESS;
+}
+
+void uart_rx_interrupt_disable(uart_handle_t* uart)
+{
+    uart->rx_interrupt = false;
+}
+
+void uart_set_rx_interrupt_callback(uart_handle_t* uart, uart_rx_inthandler_t rx_handler)
+{
+    uart->handler = rx_handler;
+}
+
+void LL_USART_Enable(USART_TypeDef* usart)
+{
+    usart->enabled = 1;
+    sim_uart.enabled = true;
+}
+
+void LL_USART_Disable(USART_TypeDef* usart)
+{
+    usart->enabled = 0;
+    sim_uart.enabled = false;
+}
+
+void LL_USART_EnableInStopMode(USART_TypeDef* usart)
+{
+    usart->stop_mode = 1;
+}
+
+void LL_USART_SetBaudRate(USART_TypeDef* usart, uint32_t clock, uint32_t oversampling, uint32_t baudrate)
+{
+    usart->baudrate = baudrate;
+    sim_uart.baudrate = baudrate;
+}
+
+uint32_t LL_USART_GetOverSampling(USART_TypeDef* usart)
+{
+    return LL_USART_OVERSAMPLING_16;
+}
+
+// the data register frees up once the previous byte moved to the shift register
+uint32_t LL_USART_IsActiveFlag_TXE(USART_TypeDef* usart)
+{
+    sim_spend(1);
+    return sim_time + sim_char_time(sim_uart.baudrate) >= sim_tx_free;
+}
+
+uint32_t LL_USART_IsActiveFlag_TC(USART_TypeDef* usart)
+{
+    sim_spend(1);
+    return sim_time >= sim_tx_free;
+}
+
+uint32_t LL_USART_IsActiveFlag_RXNE(USART_TypeDef* usart)
+{
+    return 0;
+}
+
+uint32_t LL_USART_IsActiveFlag_ORE(USART_TypeDef* usart)
+{
+    return 0;
+}
+
+void LL_USART_ClearFlag_TC(USART_TypeDef* usart)
+{
+}
+
+void LL_USART_ClearFlag_ORE(USART_TypeDef* usart)
+{
+}
+
+void LL_USART_TransmitData8(USART_TypeDef* usart, uint8_t data)
+{
+    uint64_t start = (sim_tx_free > sim_time) ? sim_tx_free : sim_time;
+    sim_tx_free = start + sim_char_time(sim_uart.baudrate);
+    if (sim_device != NULL)
+        sim_device->receive(data, sim_tx_free, sim_uart.baudrate);
+}
+
+uint8_t LL_USART_ReceiveData8(USART_TypeDef* usart)
+{
+    return 0;
+}
+
+void LL_USART_EnableIT_RXNE(USART_TypeDef* usart)
+{
+    sim_uart.rx_interrupt = true;
+}
+
+void LL_USART_DisableIT_RXNE(USART_TypeDef* usart)
+{
+    sim_uart.rx_interrupt = false;
+}
+
+// log
+
+static void sim_log(FILE* stream, const char* format, va_list args)
+{
+    fprintf(stream, "%10.3f ms  ", sim_time / 1000.0);
+    vfprintf(stream, format, args);
+    fprintf(stream, "\n");
+}
+
+void log_print_string(char* format, ...)
+{
+    va_list args;
+    if (!sim_verbose)
+        return;
+    va_start(args, format);
+    sim_log(stdout, format, args);
+    va_end(args);
+}
+
+void log_print_error_string(char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    sim_log(sim_verbose ? stdout : stderr, format, args);
+    va_end(args);
+}
+
+void log_print_data(uint8_t* message, uint32_t length)
+{
+    if (!sim_verbose)
+        return;
+    for (uint32_t i = 0; i < length; i++)
+        printf("%02X ", message[i]);
+    printf("\n");
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV, LiQuiBit VOF.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* \file
+ *
+ * Virtual time platform the firmware drivers run on, with the modbus line towards a simulated device
+ *
+ * @author contact@liquibit.be
+ */
+#ifndef __SIM_PLATFORM_H
+#define __SIM_PLATFORM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// cpu time charged for a task and for an interrupt, the code itself runs in zero virtual time
+#define SIM_TASK_COST_US 20
+#define SIM_INTERRUPT_COST_US 5
+
+// the device at the other end of the line, it sees every byte once its stop bit passed
+typedef struct {
+    void (*receive)(uint8_t byte, uint64_t time, uint32_t baudrate);
+} sim_device_t;
+
+typedef bool (*sim_condition_t)(void);
+
+void sim_attach(const sim_device_t* device);
+void sim_line_send(uint8_t byte, uint64_t time, uint32_t baudrate);
+uint64_t sim_now();
+uint64_t sim_awake();
+uint32_t sim_char_time(uint32_t baudrate);
+uint32_t sim_uart_baudrate();
+bool sim_run(sim_condition_t done, uint64_t timeout);
+void sim_set_verbose(bool verbose);
+
+#endif //__SIM_PLATFORM_H
@@ -34,8 +34,9 @@ import json
 from bitstring import ConstBitStream
 
 from custom_files.custom_files import CustomFiles
-from custom_files.energy_file import EnergyFile, EnergyConfigFile
+from custom_files.energy_file import EnergyFile, MeterEnergyFile, EnergyConfigFile
 from custom_files.button_file import ButtonFile, ButtonConfigFile
+from custom_files.poll_list_file import PollListFile, PollValuesFile
 
 import paho.mqtt.client as mqtt
 import ssl
@@ -183,7 +184,7 @@ class Modem2Mqtt():
       logging.info("Received {} content: {} from {}".format(fileType.__class__.__name__,
                                               parsedData, transmitterHexString))
 
-      if fileType.__class__ in [ButtonFile, ButtonConfigFile, EnergyFile, EnergyConfigFile]:
+      if fileType.__class__ in [ButtonFile, ButtonConfigFile, EnergyFile, MeterEnergyFile, EnergyConfigFile, PollListFile, PollValuesFile]:
         data_json = parsedData.generate_scorp_io_data(link_budget)
 
         if not data_json:
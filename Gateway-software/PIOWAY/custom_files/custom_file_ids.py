@@ -3,5 +3,12 @@ from enum import Enum
 class CustomFileIds(Enum):
     BUTTON = 51
     ENERGY = 52
+    POLL_VALUES = 53
+    METER_ENERGY = 54
+    FORWARD_REQUEST = 55
+    FORWARD_RESPONSE = 56
+    STATISTICS = 57
     BUTTON_CONFIGURATION = 61
-    ENERGY_CONFIGURATION = 62
\ No newline at end of file
+    ENERGY_CONFIGURATION = 62
+    POLL_LIST = 63
+    DISCOVERY = 64
\ No newline at end of file
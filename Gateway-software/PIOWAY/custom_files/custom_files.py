@@ -2,17 +2,28 @@ import json
 
 from .custom_file_ids import CustomFileIds
 
-from .energy_file import EnergyFile, EnergyConfigFile
+from .energy_file import EnergyFile, MeterEnergyFile, EnergyConfigFile
 from .button_file import ButtonFile, ButtonConfigFile
+from .poll_list_file import PollListFile, PollValuesFile
+from .discovery_file import DiscoveryFile
+from .forward_file import ForwardRequestFile, ForwardResponseFile
+from .statistics_file import StatisticsFile
 
 class CustomFiles:
     enum_class = CustomFileIds
 
     files = {
         CustomFileIds.ENERGY: EnergyFile(),
+        CustomFileIds.METER_ENERGY: MeterEnergyFile(),
         CustomFileIds.ENERGY_CONFIGURATION: EnergyConfigFile(),
         CustomFileIds.BUTTON: ButtonFile(),
         CustomFileIds.BUTTON_CONFIGURATION: ButtonConfigFile(),
+        CustomFileIds.POLL_VALUES: PollValuesFile(),
+        CustomFileIds.POLL_LIST: PollListFile(),
+        CustomFileIds.DISCOVERY: DiscoveryFile(),
+        CustomFileIds.FORWARD_REQUEST: ForwardRequestFile(),
+        CustomFileIds.FORWARD_RESPONSE: ForwardResponseFile(),
+        CustomFileIds.STATISTICS: StatisticsFile(),
     }
 
     global_sparkplug_config =  json.dumps({
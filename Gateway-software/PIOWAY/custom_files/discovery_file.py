@@ -0,0 +1,79 @@
+#
+# Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+#
+# This file is part of pyd7a.
+# See https://github.com/Sub-IoT/pyd7a for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+import struct
+
+from enum import Enum
+
+from pyd7a.d7a.support.schema import Validatable, Types
+from pyd7a.d7a.system_files.file import File
+from .custom_file_ids import CustomFileIds
+
+class MeterTypes(Enum):
+  UNKNOWN = 0
+  ACUREV_1312 = 1
+
+
+class DiscoveryFile(File, Validatable):
+  MAX_DEVICES = 8
+  FILE_SIZE = 3 + MAX_DEVICES * 3
+  SCHEMA = [{
+    "first_address": Types.INTEGER(min=0, max=247),
+    "last_address": Types.INTEGER(min=0, max=247),
+    # "devices": Types.LIST(), # (address, meter type, latency in ms) of every slave that answered
+  }]
+
+  def __init__(self, first_address=0, last_address=0, devices=[]):
+    self.first_address = first_address
+    self.last_address = last_address
+    self.devices = devices
+    File.__init__(self, CustomFileIds.DISCOVERY.value, self.FILE_SIZE)
+    Validatable.__init__(self)
+
+  @staticmethod
+  def scan(first_address=1, last_address=247):
+    # writing a range to the node starts a scan, the result gets sent back in the same file
+    return DiscoveryFile(first_address=first_address, last_address=last_address)
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    first_address = s.read("uint:8")
+    last_address = s.read("uint:8")
+    device_count = s.read("uint:8")
+    devices = []
+    for i in range(DiscoveryFile.MAX_DEVICES):
+      device = (s.read("uint:8"), s.read("uint:8"), s.read("uint:8"))
+      if i < device_count:
+        devices.append(device)
+    return DiscoveryFile(first_address=first_address, last_address=last_address, devices=devices)
+
+  def generate_scorp_io_data(self, link_budget):
+    return None
+
+  def __iter__(self):
+    yield self.first_address
+    yield self.last_address
+    yield len(self.devices)
+    for i in range(self.MAX_DEVICES):
+      for byte in (self.devices[i] if i < len(self.devices) else (0, 0, 0)):
+        yield byte
+
+  def __str__(self):
+    return "first_address={}, last_address={}, devices=[{}]".format(self.first_address, self.last_address,
+      ", ".join("address {} {} in {} ms".format(address, MeterTypes(type).name if type in [t.value for t in MeterTypes] else type, latency)
+                for address, type, latency in self.devices))
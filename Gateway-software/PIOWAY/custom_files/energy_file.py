@@ -109,16 +109,53 @@ class EnergyFile(File, Validatable):
       self.real_energy, self.apparent_energy, self.current, self.voltage, self.measurement_valid
     )
 
+class MeterEnergyFile(EnergyFile):
+  FILE_SIZE = 1 + EnergyFile.FILE_SIZE
+
+  def __init__(self, slave_address=1, real_energy=[], apparent_energy=[], current=[], voltage=[], measurement_valid=True):
+    EnergyFile.__init__(self, real_energy=real_energy, apparent_energy=apparent_energy, current=current, voltage=voltage, measurement_valid=measurement_valid)
+    self.slave_address = slave_address
+    File.__init__(self, CustomFileIds.METER_ENERGY.value, self.FILE_SIZE)
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    slave_address = s.read("uint:8")
+    energy = EnergyFile.parse(s)
+    return MeterEnergyFile(slave_address=slave_address, real_energy=energy.real_energy, apparent_energy=energy.apparent_energy,
+                           current=energy.current, voltage=energy.voltage, measurement_valid=energy.measurement_valid)
+
+  def generate_scorp_io_data(self, link_budget):
+    # the metrics of every meter get grouped under its slave address
+    data = json.loads(EnergyFile.generate_scorp_io_data(self, link_budget))
+    for metric in data["metrics"]:
+      metric["name"] = "Compteur {}/{}".format(self.slave_address, metric["name"])
+    return json.dumps(data)
+
+  def __iter__(self):
+    yield self.slave_address
+    for byte in EnergyFile.__iter__(self):
+      yield byte
+
+  def __str__(self):
+    return "slave_address={}, {}".format(self.slave_address, EnergyFile.__str__(self))
+
 class EnergyConfigFile(File, Validatable):
-  FILE_SIZE = 5
+  MAX_METERS = 4
+  FILE_SIZE = 11 + MAX_METERS
   SCHEMA = [{
     "interval": Types.INTEGER(min=-0, max=0xFFFFFFFF),  # uint32
-    "enabled": Types.BOOLEAN()
+    "enabled": Types.BOOLEAN(),
+    "meter_addresses": Types.LIST(Types.INTEGER(min=1, max=247), maxlength=MAX_METERS),
+    "baudrate": Types.INTEGER(min=0, max=0xFFFFFFFF),  # uint32
+    "local_slave_address": Types.INTEGER(min=0, max=247)
   }]
 
-  def __init__(self, interval=0, enabled=True):
+  def __init__(self, interval=0, enabled=True, meter_addresses=[1], baudrate=19200, local_slave_address=0):
     self.interval = interval
     self.enabled = enabled
+    self.meter_addresses = meter_addresses
+    self.baudrate = baudrate
+    self.local_slave_address = local_slave_address
     File.__init__(self, CustomFileIds.ENERGY_CONFIGURATION.value, self.FILE_SIZE)
     Validatable.__init__(self)
 
@@ -126,7 +163,12 @@ class EnergyConfigFile(File, Validatable):
   def parse(s, offset=0, length=FILE_SIZE):
     interval = s.read("uint:32")
     enabled = True if s.read("uint:8") else False
-    return EnergyConfigFile(interval=interval, enabled=enabled)
+    meter_count = s.read("uint:8")
+    meter_addresses = [s.read("uint:8") for i in range(EnergyConfigFile.MAX_METERS)][:meter_count]
+    baudrate = s.read("uintle:32")
+    local_slave_address = s.read("uint:8")
+    return EnergyConfigFile(interval=interval, enabled=enabled, meter_addresses=meter_addresses, baudrate=baudrate,
+                            local_slave_address=local_slave_address)
 
   def generate_scorp_io_data(self, link_budget):
     return None
@@ -135,9 +177,14 @@ class EnergyConfigFile(File, Validatable):
     for byte in bytearray(struct.pack(">I", self.interval)):
       yield byte
     yield self.enabled
-
+    yield len(self.meter_addresses)
+    for i in range(self.MAX_METERS):
+      yield self.meter_addresses[i] if i < len(self.meter_addresses) else 0
+    for byte in bytearray(struct.pack("<I", self.baudrate)):
+      yield byte
+    yield self.local_slave_address
 
   def __str__(self):
-    return "interval={}, enabled={}".format(
-      self.interval, self.enabled
+    return "interval={}, enabled={}, meter_addresses={}, baudrate={}, local_slave_address={}".format(
+      self.interval, self.enabled, self.meter_addresses, self.baudrate, self.local_slave_address
     )
@@ -0,0 +1,120 @@
+#
+# Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+#
+# This file is part of pyd7a.
+# See https://github.com/Sub-IoT/pyd7a for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+import struct
+
+from pyd7a.d7a.support.schema import Validatable, Types
+from pyd7a.d7a.system_files.file import File
+from .custom_file_ids import CustomFileIds
+
+
+class ForwardRequestFile(File, Validatable):
+  MAX_PDUS = 8
+  FILE_SIZE = 1 + MAX_PDUS * 6
+  SCHEMA = [{
+    # "pdus": Types.LIST(), # (slave, function, address, count or value) of every request
+  }]
+
+  def __init__(self, pdus=[]):
+    self.pdus = pdus
+    File.__init__(self, CustomFileIds.FORWARD_REQUEST.value, self.FILE_SIZE)
+    Validatable.__init__(self)
+
+  @staticmethod
+  def read_registers(slave, address, count, function=3):
+    # the answer comes back in a ForwardResponseFile, at most 29 registers fit in it
+    return ForwardRequestFile(pdus=[(slave, function, address, count)])
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    pdu_count = s.read("uint:8")
+    pdus = []
+    for i in range(ForwardRequestFile.MAX_PDUS):
+      pdu = (s.read("uint:8"), s.read("uint:8"), s.read("uint:16"), s.read("uint:16"))
+      if i < pdu_count:
+        pdus.append(pdu)
+    return ForwardRequestFile(pdus=pdus)
+
+  def generate_scorp_io_data(self, link_budget):
+    return None
+
+  def __iter__(self):
+    yield len(self.pdus)
+    for i in range(self.MAX_PDUS):
+      slave, function, address, value = self.pdus[i] if i < len(self.pdus) else (0, 0, 0, 0)
+      yield slave
+      yield function
+      for byte in bytearray(struct.pack(">HH", address, value)):
+        yield byte
+
+  def __str__(self):
+    return "pdus=[{}]".format(", ".join("slave {} function {} address {} value {}".format(*pdu) for pdu in self.pdus))
+
+
+class ForwardResponseFile(File, Validatable):
+  MAX_DATA = 60
+  FILE_SIZE = 5 + MAX_DATA
+  STATUS_REFUSED = 0xFF
+  SCHEMA = [{
+    "index": Types.INTEGER(min=0, max=0xFF),
+    "slave": Types.INTEGER(min=0, max=0xFF),
+    "function": Types.INTEGER(min=0, max=0xFF),
+    "status": Types.INTEGER(min=0, max=0xFF),
+  }]
+
+  def __init__(self, index=0, slave=0, function=0, status=0, data=b""):
+    self.index = index
+    self.slave = slave
+    self.function = function
+    self.status = status
+    self.data = data
+    File.__init__(self, CustomFileIds.FORWARD_RESPONSE.value, self.FILE_SIZE)
+    Validatable.__init__(self)
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    index = s.read("uint:8")
+    slave = s.read("uint:8")
+    function = s.read("uint:8")
+    status = s.read("uint:8")
+    data_length = s.read("uint:8")
+    data = bytes([s.read("uint:8") for i in range(ForwardResponseFile.MAX_DATA)][:data_length])
+    return ForwardResponseFile(index=index, slave=slave, function=function, status=status, data=data)
+
+  def registers(self):
+    # a read answer starts with its byte count, followed by the big endian registers
+    if self.status != 0 or self.function not in (3, 4) or len(self.data) < 1:
+      return []
+    return list(struct.unpack(">{}H".format(self.data[0] // 2), self.data[1:1 + self.data[0]]))
+
+  def generate_scorp_io_data(self, link_budget):
+    return None
+
+  def __iter__(self):
+    yield self.index
+    yield self.slave
+    yield self.function
+    yield self.status
+    yield len(self.data)
+    for i in range(self.MAX_DATA):
+      yield self.data[i] if i < len(self.data) else 0
+
+  def __str__(self):
+    return "index={}, slave={}, function={}, status={}, data={}".format(
+      self.index, self.slave, self.function, "refused" if self.status == self.STATUS_REFUSED else self.status,
+      self.data.hex())
@@ -0,0 +1,154 @@
+#
+# Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+#
+# This file is part of pyd7a.
+# See https://github.com/Sub-IoT/pyd7a for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+import struct
+import json
+import time
+
+from pyd7a.d7a.support.schema import Validatable, Types
+from pyd7a.d7a.system_files.file import File
+from .custom_file_ids import CustomFileIds
+
+
+class PollEntry(Validatable):
+  NO_SCALE_REGISTER = 0xFFFF
+  # type: 0 = uint16, 1 = int16, 2 = uint32, 3 = int32
+  SCHEMA = [{
+    "slave": Types.INTEGER(min=0, max=0xFF),
+    "start_register": Types.INTEGER(min=0, max=0xFFFF),
+    "count": Types.INTEGER(min=1, max=0x7F),
+    "type": Types.INTEGER(min=0, max=3),
+    "scale_register": Types.INTEGER(min=0, max=0xFFFF),
+    "exponent": Types.INTEGER(min=-0x80, max=0x7F)
+  }]
+
+  def __init__(self, slave=1, start_register=0, count=1, type=0, scale_register=NO_SCALE_REGISTER, exponent=0):
+    self.slave = slave
+    self.start_register = start_register
+    self.count = count
+    self.type = type
+    self.scale_register = scale_register
+    self.exponent = exponent
+    Validatable.__init__(self)
+
+  @staticmethod
+  def parse(s):
+    slave = s.read("uint:8")
+    start_register = s.read("uintle:16")
+    count = s.read("uint:8")
+    type = s.read("uint:8")
+    scale_register = s.read("uintle:16")
+    exponent = s.read("int:8")
+    return PollEntry(slave=slave, start_register=start_register, count=count, type=type, scale_register=scale_register, exponent=exponent)
+
+  def __iter__(self):
+    for byte in bytearray(struct.pack("<BHBBHb", self.slave, self.start_register, self.count, self.type, self.scale_register, self.exponent)):
+      yield byte
+
+  def __str__(self):
+    return "slave={}, start_register={}, count={}, type={}, scale_register={}, exponent={}".format(
+      self.slave, self.start_register, self.count, self.type, self.scale_register, self.exponent
+    )
+
+
+class PollListFile(File, Validatable):
+  MAX_ENTRIES = 8
+  ENTRY_SIZE = 8
+  FILE_SIZE = 1 + MAX_ENTRIES * ENTRY_SIZE
+  SCHEMA = [{
+    "entries": Types.LIST(PollEntry, maxlength=MAX_ENTRIES)
+  }]
+
+  def __init__(self, entries=[]):
+    self.entries = entries
+    File.__init__(self, CustomFileIds.POLL_LIST.value, self.FILE_SIZE)
+    Validatable.__init__(self)
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    entry_count = s.read("uint:8")
+    entries = [PollEntry.parse(s) for i in range(min(entry_count, PollListFile.MAX_ENTRIES))]
+    return PollListFile(entries=entries)
+
+  def generate_scorp_io_data(self, link_budget):
+    return None
+
+  def __iter__(self):
+    yield len(self.entries)
+    for entry in self.entries:
+      for byte in entry:
+        yield byte
+    for i in range((self.MAX_ENTRIES - len(self.entries)) * self.ENTRY_SIZE):
+      yield 0
+
+  def __str__(self):
+    return "entries=[{}]".format("; ".join(str(entry) for entry in self.entries))
+
+
+class PollValuesFile(File, Validatable):
+  FILE_SIZE = 64
+  WIDE = 0x80 # set in the header of a block when its values are 64 bit instead of 32 bit
+  SCHEMA = [{
+    # "valid_entries": Types.INTEGER(min=0, max=0xFF), # bit per entry of the poll list
+    # "blocks": Types.LIST(Types.LIST(Types.INTEGER())), # converted values per entry of the poll list
+  }]
+
+  def __init__(self, valid_entries=0, blocks=[]):
+    self.valid_entries = valid_entries
+    self.blocks = blocks
+    File.__init__(self, CustomFileIds.POLL_VALUES.value, self.FILE_SIZE)
+    Validatable.__init__(self)
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    valid_entries = s.read("uint:8")
+    entry_count = s.read("uint:8")
+    blocks = []
+    for i in range(entry_count):
+      header = s.read("uint:8")
+      value_format = "intle:64" if header & PollValuesFile.WIDE else "intle:32"
+      blocks.append([s.read(value_format) for v in range(header & ~PollValuesFile.WIDE)])
+    return PollValuesFile(valid_entries=valid_entries, blocks=blocks)
+
+  def generate_scorp_io_data(self, link_budget):
+    timestamp = round( time.time() * 1000 ) # get time in milliseconds
+    metrics = []
+    for entry, block in enumerate(self.blocks):
+      if not self.valid_entries & (1 << entry):
+        continue
+      for index, value in enumerate(block):
+        metrics.append({ "name":"Liste de lecture/Entrée {}/Valeur {}".format(entry + 1, index + 1), "dataType":"Long", "timestamp":timestamp, "value":value })
+    metrics.append({ "name":"Force du signal radio DASH7",       "dataType":"Short",   "timestamp":timestamp, "value":link_budget })
+    metrics.append({ "name":"État de la liaison Modbus - DASH7", "dataType":"Boolean", "timestamp":timestamp, "value":self.valid_entries == (1 << len(self.blocks)) - 1 })
+    data_json = json.dumps({ "metrics" : metrics })
+
+    return data_json
+
+  def __iter__(self):
+    data = bytearray([self.valid_entries, len(self.blocks)])
+    for block in self.blocks:
+      wide = any(value < -0x80000000 or value > 0x7FFFFFFF for value in block)
+      data.append(len(block) | (self.WIDE if wide else 0))
+      for value in block:
+        data += struct.pack("<q" if wide else "<i", value)
+    data += bytearray(self.FILE_SIZE - len(data))
+    for byte in data:
+      yield byte
+
+  def __str__(self):
+    return "valid_entries={:#04x}, blocks={}".format(self.valid_entries, self.blocks)
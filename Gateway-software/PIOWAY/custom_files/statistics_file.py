@@ -0,0 +1,71 @@
+#
+# Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+#
+# This file is part of pyd7a.
+# See https://github.com/Sub-IoT/pyd7a for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+import struct
+
+from pyd7a.d7a.support.schema import Validatable, Types
+from pyd7a.d7a.system_files.file import File
+from .custom_file_ids import CustomFileIds
+
+class StatisticsFile(File, Validatable):
+  FUNCTIONS = 4
+  LATENCY_LIMITS = [10, 20, 50, 100, 200]  # ms, the last bucket holds all slower answers
+  COUNTERS = ["requests", "successes", "timeouts", "crc_errors", "exceptions", "overruns", "recovered", "discarded"]
+  FILE_SIZE = 2 * len(COUNTERS) + FUNCTIONS * (1 + 2 * (len(LATENCY_LIMITS) + 1))
+  SCHEMA = [{
+    # "counters": Types.DICT(), # outcome of all transactions since boot
+    # "latency": Types.DICT(), # response time histogram per function code
+  }]
+
+  def __init__(self, counters={}, latency={}):
+    self.counters = counters
+    self.latency = latency
+    File.__init__(self, CustomFileIds.STATISTICS.value, self.FILE_SIZE)
+    Validatable.__init__(self)
+
+  @staticmethod
+  def parse(s, offset=0, length=FILE_SIZE):
+    counters = {name: s.read("uintle:16") for name in StatisticsFile.COUNTERS}
+    latency = {}
+    for i in range(StatisticsFile.FUNCTIONS):
+      function = s.read("uint:8")
+      buckets = [s.read("uintle:16") for j in range(len(StatisticsFile.LATENCY_LIMITS) + 1)]
+      if function != 0:
+        latency[function] = buckets
+    return StatisticsFile(counters=counters, latency=latency)
+
+  def generate_scorp_io_data(self, link_budget):
+    return None
+
+  def __iter__(self):
+    for name in self.COUNTERS:
+      for byte in bytearray(struct.pack("<H", self.counters.get(name, 0))):
+        yield byte
+    functions = list(self.latency.items())
+    for i in range(self.FUNCTIONS):
+      function, buckets = functions[i] if i < len(functions) else (0, [0] * (len(self.LATENCY_LIMITS) + 1))
+      yield function
+      for byte in bytearray(struct.pack("<{}H".format(len(buckets)), *buckets)):
+        yield byte
+
+  def __str__(self):
+    limits = ["<{}ms".format(limit) for limit in self.LATENCY_LIMITS] + [">={}ms".format(self.LATENCY_LIMITS[-1])]
+    return "{}, latency=[{}]".format(
+      ", ".join("{}={}".format(name, self.counters.get(name, 0)) for name in self.COUNTERS),
+      ", ".join("function {}: {}".format(function, " ".join("{}:{}".format(limit, count) for limit, count in zip(limits, buckets)))
+                for function, buckets in self.latency.items()))